@@ -0,0 +1,468 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include "MarchingCubes.h"
+#include "VolumeGenerators.h"
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+// meshes the example volumes scaled up to large sizes, and reports the time of every phase, the throughput
+// and the peak memory of the process. run with --help for the options
+
+struct BenchmarkOptions {
+	std::vector<std::string> fields;
+	std::vector<int> sizes;
+	int threadCount;
+	int repeatCount;
+	std::string format;
+	bool loadFromFile;
+	std::string directory;
+	std::string jsonPath;
+	bool compareTraversal;
+	BenchmarkOptions();
+};
+
+BenchmarkOptions::BenchmarkOptions() {
+	fields = { "cube", "roundcube", "flat", "waved", "sphere", "noise" };
+	sizes = { 64, 128, 256 };
+	threadCount = 1;
+	repeatCount = 3;
+	format = "ply";
+	loadFromFile = true;
+	directory = ".";
+	compareTraversal = false;
+}
+
+struct BenchmarkResult {
+	std::string field;
+	int size;
+	int threadCount;
+	int64 cubeCount;
+	int vertexCount;
+	int triangleCount;
+	double generateSeconds;
+	double loadSeconds;
+	double meshSeconds;
+	double meshMeanSeconds;
+	double writeSeconds;
+	int64 writtenByteCount;
+	int64 meshPeakByteCount;
+	int64 peakRssByteCount;
+	// MarchingStats of the last meshing and the write, empty unless built with MARCHING_CUBES_STATS
+	std::string statsJson;
+};
+
+// the two cube orders of --traversal over the same volume, the fastest of the repeats
+struct TraversalResult {
+	std::string field;
+	int size;
+	int64 cubeCount;
+	int64 activeCubeCount;
+	double memoryOrderSeconds;
+	double zMajorOrderSeconds;
+};
+
+#if defined(_WIN32)
+// the peak working set can't be reset, so it is the peak of every case so far
+static void resetPeakRss() {
+}
+
+static int64 getPeakRss() {
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return -1;
+	}
+	return (int64)counters.PeakWorkingSetSize;
+}
+#else
+// linux resets the peak resident set size (VmHWM) of the process when 5 is written to clear_refs
+static void resetPeakRss() {
+	FILE* file = fopen("/proc/self/clear_refs", "w");
+	if (file != NULL) {
+		fputs("5", file);
+		fclose(file);
+	}
+}
+
+static int64 getPeakRss() {
+	FILE* file = fopen("/proc/self/status", "r");
+	if (file != NULL) {
+		char line[256];
+		while (fgets(line, sizeof(line), file) != NULL) {
+			long long kiloByteCount;
+			if (strncmp(line, "VmHWM:", 6) == 0 && sscanf(line + 6, "%lld", &kiloByteCount) == 1) {
+				fclose(file);
+				return (int64)kiloByteCount * 1024;
+			}
+		}
+		fclose(file);
+	}
+	// the peak of the whole process where there is no procfs, in kilobytes on linux and bytes on macOS
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+	return (int64)usage.ru_maxrss;
+#else
+	return (int64)usage.ru_maxrss * 1024;
+#endif
+}
+#endif
+
+static double getSeconds(std::chrono::steady_clock::time_point begin) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+static int64 getFileByteCount(const std::string& filename) {
+	FILE* file = fopen(filename.c_str(), "rb");
+	if (file == NULL) {
+		return 0;
+	}
+	fseek(file, 0, SEEK_END);
+	int64 byteCount = ftell(file);
+	fclose(file);
+	return byteCount;
+}
+
+static VolumetricData<int8>* generateField(const std::string& field, int size) {
+	if (field == "cube") {
+		return new VolumetricData<int8>(getVolumetricDataOfACube(size, size, size));
+	}
+	if (field == "roundcube") {
+		return new VolumetricData<int8>(getVolumetricDataOfARoundEdgeCube(size, size, size));
+	}
+	if (field == "flat") {
+		return new VolumetricData<int8>(getVolumetricDataOfFlatTerrain(size, size, size));
+	}
+	if (field == "waved") {
+		return new VolumetricData<int8>(getVolumetricDataOfWavedTerrain(size, size, size));
+	}
+	if (field == "sphere") {
+		return new VolumetricData<int8>(getVolumetricDataOfASphere(size, size, size));
+	}
+	if (field == "noise") {
+		return new VolumetricData<int8>(getVolumetricDataOfNoise(size, size, size));
+	}
+	throw std::runtime_error("Unknown field " + field);
+}
+
+// the mesh files are removed once their size is known, their content is not checked
+static void writeMesh(MarchedGeometry<uint32>& geometry, const BenchmarkOptions& options, BenchmarkResult& result) {
+	result.writeSeconds = 0;
+	result.writtenByteCount = 0;
+	if (options.format == "none") {
+		return;
+	}
+	std::string filename = options.directory + "/benchmark_mesh." + options.format;
+	std::string indexFilename = options.directory + "/benchmark_mesh.ib";
+	auto begin = std::chrono::steady_clock::now();
+	if (options.format == "ply") {
+		geometry.toPlyFile(filename.c_str());
+	}
+	else if (options.format == "obj") {
+		geometry.toObjFile(filename.c_str());
+	}
+	else if (options.format == "txt") {
+		geometry.toFile(filename.c_str());
+	}
+	else if (options.format == "raw") {
+		geometry.toRawFiles(filename.c_str(), indexFilename.c_str());
+	}
+	else {
+		throw std::runtime_error("Unknown format " + options.format);
+	}
+	result.writeSeconds = getSeconds(begin);
+	result.writtenByteCount = getFileByteCount(filename);
+	std::remove(filename.c_str());
+	if (options.format == "raw") {
+		result.writtenByteCount += getFileByteCount(indexFilename);
+		std::remove(indexFilename.c_str());
+	}
+}
+
+// classifies every cube from its 8 corners, visiting the cubes either in the memory order of VolumetricData, with
+// z innermost, or in the z-major order the marcher used to walk, with x innermost and every corner fetch a slice
+// apart from the last one. returns the cubes that have surface, the same in both orders
+static int64 classifyCubes(VolumetricView<int8> field, bool isMemoryOrder) {
+	int cubeCount[3] = { field.getSizeX() - 1, field.getSizeY() - 1, field.getSizeZ() - 1 };
+	int outerAxis = isMemoryOrder ? 0 : 2, innerAxis = isMemoryOrder ? 2 : 0;
+	int64 activeCubeCount = 0;
+	int cube[3];
+	for (cube[outerAxis] = 0; cube[outerAxis] < cubeCount[outerAxis]; cube[outerAxis]++) {
+		for (cube[1] = 0; cube[1] < cubeCount[1]; cube[1]++) {
+			for (cube[innerAxis] = 0; cube[innerAxis] < cubeCount[innerAxis]; cube[innerAxis]++) {
+				int caseIndex = 0;
+				for (int corner = 0; corner < 8; corner++) {
+					int8 value = field.getUnchecked(cube[0] + (corner & 1), cube[1] + ((corner >> 1) & 1), cube[2] + ((corner >> 2) & 1));
+					caseIndex |= (value < 0) << corner;
+				}
+				activeCubeCount += (caseIndex != 0 && caseIndex != 0xFF) ? 1 : 0;
+			}
+		}
+	}
+	return activeCubeCount;
+}
+
+// the traversal order of the marcher alone, without the rest of the meshing. hardware cache misses are in the
+// stats of a MARCHING_CUBES_STATS build, this only times the two orders
+static TraversalResult runTraversalBenchmark(const std::string& field, int size, const BenchmarkOptions& options) {
+	TraversalResult result;
+	result.field = field;
+	result.size = size;
+	result.cubeCount = (int64)(size - 1) * (size - 1) * (size - 1);
+	std::unique_ptr<VolumetricData<int8>> volume(generateField(field, size));
+	for (int i = 0; i < options.repeatCount; i++) {
+		for (int order = 0; order < 2; order++) {
+			auto begin = std::chrono::steady_clock::now();
+			result.activeCubeCount = classifyCubes(volume->getView(), order == 0);
+			double seconds = getSeconds(begin);
+			double& bestSeconds = (order == 0) ? result.memoryOrderSeconds : result.zMajorOrderSeconds;
+			bestSeconds = (i == 0) ? seconds : std::min(bestSeconds, seconds);
+		}
+	}
+	return result;
+}
+
+static BenchmarkResult runBenchmark(const std::string& field, int size, const BenchmarkOptions& options) {
+	BenchmarkResult result;
+	result.field = field;
+	result.size = size;
+	result.threadCount = options.threadCount;
+	result.cubeCount = (int64)(size - 1) * (size - 1) * (size - 1);
+	resetPeakRss();
+	auto begin = std::chrono::steady_clock::now();
+	std::unique_ptr<VolumetricData<int8>> volume(generateField(field, size));
+	result.generateSeconds = getSeconds(begin);
+	result.loadSeconds = 0;
+	std::string volumeFilename = options.directory + "/benchmark_volume.vol";
+	if (options.loadFromFile) {
+		// the volume is stored untimed, then loaded back the way an application would
+		volume->toBinaryFile(volumeFilename.c_str());
+		volume.reset();
+		begin = std::chrono::steady_clock::now();
+		volume.reset(new VolumetricData<int8>(VolumetricData<int8>::fromFile(volumeFilename.c_str())));
+		result.loadSeconds = getSeconds(begin);
+	}
+	MarchingSettings settings(options.threadCount);
+	std::unique_ptr<MarchedGeometry<uint32>> geometry;
+	double totalMeshSeconds = 0;
+	result.meshSeconds = 0;
+	for (int i = 0; i < options.repeatCount; i++) {
+		geometry.reset();
+		begin = std::chrono::steady_clock::now();
+		geometry.reset(new MarchedGeometry<uint32>(Vector3D(1, 1, 1), *volume, settings));
+		double seconds = getSeconds(begin);
+		totalMeshSeconds += seconds;
+		result.meshSeconds = (i == 0) ? seconds : std::min(result.meshSeconds, seconds);
+	}
+	result.meshMeanSeconds = totalMeshSeconds / options.repeatCount;
+	result.vertexCount = geometry->getVertexCount();
+	result.triangleCount = geometry->getTriangleCount();
+	result.meshPeakByteCount = geometry->getPeakByteCount();
+	volume.reset();
+	if (options.loadFromFile) {
+		std::remove(volumeFilename.c_str());
+	}
+	writeMesh(*geometry, options, result);
+	if (geometry->getStats().isEnabled) {
+		result.statsJson = geometry->getStats().toJson();
+	}
+	geometry.reset();
+	result.peakRssByteCount = getPeakRss();
+	return result;
+}
+
+static void writeJson(FILE* file, const BenchmarkOptions& options, const std::vector<BenchmarkResult>& results) {
+	fprintf(file, "{\n\t\"benchmark\": \"marching-cubes\",\n\t\"version\": 1,\n");
+	fprintf(file, "\t\"format\": \"%s\",\n\t\"loadFromFile\": %s,\n\t\"repeatCount\": %d,\n", options.format.c_str(), options.loadFromFile ? "true" : "false", options.repeatCount);
+	fprintf(file, "\t\"results\": [");
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchmarkResult& result = results[i];
+		fprintf(file, "%s\n\t\t{", (i == 0) ? "" : ",");
+		fprintf(file, "\"field\": \"%s\", \"size\": [%d, %d, %d], \"threads\": %d, ", result.field.c_str(), result.size, result.size, result.size, result.threadCount);
+		fprintf(file, "\"cubes\": %lld, \"vertices\": %d, \"triangles\": %d, ", (long long)result.cubeCount, result.vertexCount, result.triangleCount);
+		fprintf(file, "\"generateSeconds\": %.6f, \"loadSeconds\": %.6f, \"meshSeconds\": %.6f, \"meshMeanSeconds\": %.6f, \"writeSeconds\": %.6f, ", result.generateSeconds, result.loadSeconds, result.meshSeconds, result.meshMeanSeconds, result.writeSeconds);
+		fprintf(file, "\"cubesPerSecond\": %.1f, \"trianglesPerSecond\": %.1f, ", result.cubeCount / result.meshSeconds, result.triangleCount / result.meshSeconds);
+		fprintf(file, "\"writtenBytes\": %lld, \"meshPeakBytes\": %lld, \"peakRssBytes\": %lld", (long long)result.writtenByteCount, (long long)result.meshPeakByteCount, (long long)result.peakRssByteCount);
+		if (!result.statsJson.empty()) {
+			fprintf(file, ", \"stats\": %s", result.statsJson.c_str());
+		}
+		fprintf(file, "}");
+	}
+	fprintf(file, "\n\t]\n}\n");
+}
+
+static void writeTraversalJson(FILE* file, const BenchmarkOptions& options, const std::vector<TraversalResult>& results) {
+	fprintf(file, "{\n\t\"benchmark\": \"marching-cubes-traversal\",\n\t\"version\": 1,\n\t\"repeatCount\": %d,\n", options.repeatCount);
+	fprintf(file, "\t\"results\": [");
+	for (size_t i = 0; i < results.size(); i++) {
+		const TraversalResult& result = results[i];
+		fprintf(file, "%s\n\t\t{", (i == 0) ? "" : ",");
+		fprintf(file, "\"field\": \"%s\", \"size\": [%d, %d, %d], \"cubes\": %lld, \"activeCubes\": %lld, ", result.field.c_str(), result.size, result.size, result.size, (long long)result.cubeCount, (long long)result.activeCubeCount);
+		fprintf(file, "\"memoryOrderSeconds\": %.6f, \"zMajorOrderSeconds\": %.6f, \"speedup\": %.3f}", result.memoryOrderSeconds, result.zMajorOrderSeconds, result.zMajorOrderSeconds / result.memoryOrderSeconds);
+	}
+	fprintf(file, "\n\t]\n}\n");
+}
+
+static std::vector<std::string> splitList(const char list[]) {
+	std::vector<std::string> items;
+	std::string item;
+	for (const char* c = list; ; c++) {
+		if (*c == ',' || *c == '\0') {
+			if (!item.empty()) {
+				items.push_back(item);
+			}
+			item.clear();
+			if (*c == '\0') {
+				break;
+			}
+		}
+		else {
+			item += *c;
+		}
+	}
+	return items;
+}
+
+static void printUsage() {
+	printf("usage: MarchingCubesBenchmark [options]\n");
+	printf("  --fields a,b,...  cube, roundcube, flat, waved, sphere and noise (default all)\n");
+	printf("  --sizes n,m,...   samples along every axis, 64 to 1024 (default 64,128,256)\n");
+	printf("  --threads n       threads of MarchingSettings, 0 for every hardware thread (default 1)\n");
+	printf("  --repeat n        meshes every volume n times, the fastest is reported (default 3)\n");
+	printf("  --format f        mesh file written: ply, obj, txt, raw or none (default ply)\n");
+	printf("  --no-load         meshes the generated volume instead of loading it from a binary volume file\n");
+	printf("  --directory d     directory of the temporary volume and mesh files (default .)\n");
+	printf("  --json path       writes the results as JSON, - for the standard output\n");
+	printf("  --traversal       instead of meshing, times classifying every cube in memory order and in the\n");
+	printf("                    z-major order of the first marcher, on the generated volumes\n");
+}
+
+static BenchmarkOptions parseOptions(int argc, char* argv[]) {
+	BenchmarkOptions options;
+	for (int i = 1; i < argc; i++) {
+		std::string option = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if (option == "--no-load") {
+			options.loadFromFile = false;
+		}
+		else if (option == "--traversal") {
+			options.compareTraversal = true;
+		}
+		else if (option == "--help" || option == "-h") {
+			printUsage();
+			exit(0);
+		}
+		else if (!hasValue) {
+			throw std::runtime_error("Missing value or unknown option " + option);
+		}
+		else if (option == "--fields") {
+			options.fields = splitList(argv[++i]);
+		}
+		else if (option == "--sizes") {
+			options.sizes.clear();
+			std::vector<std::string> sizes = splitList(argv[++i]);
+			for (size_t j = 0; j < sizes.size(); j++) {
+				options.sizes.push_back(atoi(sizes[j].c_str()));
+			}
+		}
+		else if (option == "--threads") {
+			options.threadCount = atoi(argv[++i]);
+		}
+		else if (option == "--repeat") {
+			options.repeatCount = std::max(atoi(argv[++i]), 1);
+		}
+		else if (option == "--format") {
+			options.format = argv[++i];
+		}
+		else if (option == "--directory") {
+			options.directory = argv[++i];
+		}
+		else if (option == "--json") {
+			options.jsonPath = argv[++i];
+		}
+		else {
+			throw std::runtime_error("Unknown option " + option);
+		}
+	}
+	for (size_t i = 0; i < options.sizes.size(); i++) {
+		if (options.sizes[i] < 2 || options.sizes[i] > 1290) {
+			throw std::runtime_error("Volume sizes must be in [2, 1290]");
+		}
+	}
+	return options;
+}
+
+static void compareTraversal(FILE* log, const BenchmarkOptions& options) {
+	fprintf(log, "%-10s %6s %11s %11s %13s %13s %8s\n", "field", "size", "Mcubes", "active", "memory order", "z-major order", "speedup");
+	std::vector<TraversalResult> results;
+	for (size_t i = 0; i < options.fields.size(); i++) {
+		for (size_t j = 0; j < options.sizes.size(); j++) {
+			TraversalResult result = runTraversalBenchmark(options.fields[i], options.sizes[j], options);
+			fprintf(log, "%-10s %6d %11.2f %11lld %13.4f %13.4f %7.2fx\n", result.field.c_str(), result.size, result.cubeCount * 1e-6, (long long)result.activeCubeCount,
+				result.memoryOrderSeconds, result.zMajorOrderSeconds, result.zMajorOrderSeconds / result.memoryOrderSeconds);
+			fflush(log);
+			results.push_back(result);
+		}
+	}
+	if (options.jsonPath == "-") {
+		writeTraversalJson(stdout, options, results);
+	}
+	else if (!options.jsonPath.empty()) {
+		FILE* file = fopen(options.jsonPath.c_str(), "w");
+		if (file == NULL) {
+			throw std::runtime_error("Can't open " + options.jsonPath);
+		}
+		writeTraversalJson(file, options, results);
+		fclose(file);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	try {
+		BenchmarkOptions options = parseOptions(argc, argv);
+		// the table goes to stderr when the JSON is written to stdout
+		FILE* log = (options.jsonPath == "-") ? stderr : stdout;
+		if (options.compareTraversal) {
+			compareTraversal(log, options);
+			return 0;
+		}
+		fprintf(log, "%-10s %6s %7s %9s %9s %9s %9s %10s %10s %11s %9s\n", "field", "size", "threads", "generate", "load", "mesh", "write", "Mcubes/s", "Mtris/s", "triangles", "peak MB");
+		std::vector<BenchmarkResult> results;
+		for (size_t i = 0; i < options.fields.size(); i++) {
+			for (size_t j = 0; j < options.sizes.size(); j++) {
+				BenchmarkResult result = runBenchmark(options.fields[i], options.sizes[j], options);
+				fprintf(log, "%-10s %6d %7d %9.4f %9.4f %9.4f %9.4f %10.2f %10.2f %11d %9.1f\n", result.field.c_str(), result.size, result.threadCount,
+					result.generateSeconds, result.loadSeconds, result.meshSeconds, result.writeSeconds,
+					result.cubeCount / result.meshSeconds * 1e-6, result.triangleCount / result.meshSeconds * 1e-6, result.triangleCount, result.peakRssByteCount / 1048576.0);
+				fflush(log);
+				results.push_back(result);
+			}
+		}
+		if (options.jsonPath == "-") {
+			writeJson(stdout, options, results);
+		}
+		else if (!options.jsonPath.empty()) {
+			FILE* file = fopen(options.jsonPath.c_str(), "w");
+			if (file == NULL) {
+				throw std::runtime_error("Can't open " + options.jsonPath);
+			}
+			writeJson(file, options, results);
+			fclose(file);
+		}
+	}
+	catch (const std::exception& exception) {
+		fprintf(stderr, "%s\n", exception.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,87 @@
+#include <cstdio>
+#include <cmath>
+#include "MarchingCubes.h"
+#include "VolumeGenerators.h"
+
+// checks that every vertex of a mesh lies where the field crosses the iso-value, on fields with many samples
+// right at the iso-value. a vertex on a sample must be on one at the iso-value, and a vertex inside an edge must
+// be where the samples at its ends interpolate to the iso-value, up to the fixed point precision of its
+// position. returns 1 if any mesh fails
+
+const int SIZE = 25;
+
+template<typename SampleType>
+VolumetricData<SampleType> sampleField(FieldFunction& field, float sampleScale, float isoValue) {
+	VolumetricData<SampleType> data(SIZE, SIZE, SIZE);
+	for (int i = 0; i < SIZE; i++) {
+		SampleType* slice = data.getWritableSlice(i);
+		for (int j = 0; j < SIZE; j++) {
+			for (int k = 0; k < SIZE; k++) {
+				// rounded, so that every sample close to the surface is right at the iso-value
+				float value = std::round(std::max(-100.0f, std::min(100.0f, field.evaluate((float)i, (float)j, (float)k) * sampleScale)));
+				slice[j * SIZE + k] = (SampleType)(value + isoValue);
+			}
+		}
+	}
+	return data;
+}
+
+template<typename SampleType>
+bool checkMesh(const char* name, VolumetricData<SampleType>& data, float isoValue, int threadCount) {
+	MarchingSettings settings(threadCount);
+	settings.isoValue = isoValue;
+	MarchedGeometry<uint32, SampleType> geometry(Vector3D(1, 1, 1), data.getView(), settings);
+	const Vertex* vertex = geometry.getVertices();
+	int sampleVertexCount = 0, misplacedVertexCount = 0;
+	for (int i = 0; i < geometry.getVertexCount(); i++) {
+		float position[3] = { vertex[i].position.x, vertex[i].position.y, vertex[i].position.z };
+		int sample[3], edgeAxis = -1;
+		for (int axis = 0; axis < 3; axis++) {
+			sample[axis] = (int)std::floor(position[axis]);
+			if (position[axis] != sample[axis]) {
+				edgeAxis = axis;
+			}
+		}
+		float value0 = (float)data.get(sample[0], sample[1], sample[2]) - isoValue;
+		if (edgeAxis < 0) {
+			sampleVertexCount++;
+			misplacedVertexCount += (value0 != 0) ? 1 : 0;
+			continue;
+		}
+		sample[edgeAxis]++;
+		float value1 = (float)data.get(sample[0], sample[1], sample[2]) - isoValue;
+		float t = position[edgeAxis] - std::floor(position[edgeAxis]);
+		bool isCrossed = (value0 < 0) != (value1 < 0);
+		if (!isCrossed || std::abs(value0 + (value1 - value0) * t) > std::abs(value1 - value0) / 256 + 1e-3f) {
+			misplacedVertexCount++;
+		}
+	}
+	// a field with no vertex on a sample checks nothing
+	bool isPassed = sampleVertexCount > 0 && misplacedVertexCount == 0;
+	printf("%-6s iso %4.1f threads %d: %5d vertices, %4d on samples, %d misplaced%s\n", name, isoValue, threadCount,
+		geometry.getVertexCount(), sampleVertexCount, misplacedVertexCount, isPassed ? "" : "  FAILED");
+	return isPassed;
+}
+
+int main() {
+	try {
+		SphereField sphere(SIZE * 0.5f, SIZE * 0.5f, SIZE * 0.5f, SIZE * 0.4f);
+		VolumetricData<int8> byteData = sampleField<int8>(sphere, 4, 0);
+		VolumetricData<int8> shiftedByteData = sampleField<int8>(sphere, 4, 3);
+		VolumetricData<int16> shortData = sampleField<int16>(sphere, 4, 0);
+		VolumetricData<float> floatData = sampleField<float>(sphere, 4, 0.5f);
+		bool isPassed = true;
+		// several threads place the vertices on the planes between their slabs from both sides
+		for (int threadCount = 1; threadCount <= 4; threadCount += 3) {
+			isPassed = checkMesh("int8", byteData, 0, threadCount) && isPassed;
+			isPassed = checkMesh("int8", shiftedByteData, 3, threadCount) && isPassed;
+			isPassed = checkMesh("int16", shortData, 0, threadCount) && isPassed;
+			isPassed = checkMesh("float", floatData, 0.5f, threadCount) && isPassed;
+		}
+		return isPassed ? 0 : 1;
+	}
+	catch (const std::exception& exception) {
+		fprintf(stderr, "%s\n", exception.what());
+		return 1;
+	}
+}
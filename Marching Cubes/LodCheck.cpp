@@ -0,0 +1,192 @@
+#include <cstdio>
+#include <cmath>
+#include <array>
+#include <map>
+#include <utility>
+#include "MarchingCubes.h"
+#include "VolumeGenerators.h"
+
+// checks that a LodGeometry chunk with a transition face joins its neighbor marched at half its stride without
+// cracks. the vertices of both chunks are merged by position, then every edge inside the pair of chunks must be
+// used as often by triangles running along it as by triangles running against it, and every edge on the outer
+// faces of the pair at most once more in one direction. sheets of the surface that touch at a sample right at
+// the iso-value share their edges there, so an edge can be used by two pairs of triangles, and the surface can
+// run along an outer face. returns 1 if any chunk pair fails
+
+const int CHUNK_CUBE_COUNT = 16;
+
+typedef std::array<long, 3> PositionKey;
+
+class CrackCheck
+{
+private:
+	long boundary[3];
+	std::map<PositionKey, int> vertexIndex;
+	std::vector<PositionKey> vertexKey;
+	// for the edge from the lower vertex index to the higher one, the triangles along it and against it
+	std::map<std::pair<int, int>, std::pair<int, int>> edgeUse;
+	int getVertex(const Vector3D& position, const int offset[3]);
+	bool isOnBoundary(int vertex0, int vertex1);
+	bool isUnmatched(int vertex0, int vertex1, const std::pair<int, int>& use);
+public:
+	CrackCheck(const int size[3]);
+	void addMesh(LodGeometry<uint32>& mesh, const int offset[3]);
+	int countOpenEdges();
+	int countMiswoundEdges();
+	int countSampleVertices(int axis, int position);
+};
+
+// size is in samples. positions are on a grid of 1/4096 sample, which is exact for the interpolated positions
+// of unit cubes
+CrackCheck::CrackCheck(const int size[3]) {
+	for (int axis = 0; axis < 3; axis++) {
+		boundary[axis] = (long)(size[axis] - 1) * 4096;
+	}
+}
+
+int CrackCheck::getVertex(const Vector3D& position, const int offset[3]) {
+	PositionKey key = { std::lround((position.x + offset[0]) * 4096), std::lround((position.y + offset[1]) * 4096), std::lround((position.z + offset[2]) * 4096) };
+	std::map<PositionKey, int>::iterator found = vertexIndex.find(key);
+	if (found != vertexIndex.end()) {
+		return found->second;
+	}
+	vertexIndex[key] = (int)vertexKey.size();
+	vertexKey.push_back(key);
+	return (int)vertexKey.size() - 1;
+}
+
+bool CrackCheck::isOnBoundary(int vertex0, int vertex1) {
+	for (int axis = 0; axis < 3; axis++) {
+		long coordinate = vertexKey[vertex0][axis];
+		if ((coordinate == 0 || coordinate == boundary[axis]) && vertexKey[vertex1][axis] == coordinate) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void CrackCheck::addMesh(LodGeometry<uint32>& mesh, const int offset[3]) {
+	const Vertex* vertex = mesh.getVertices();
+	const IndexedTriangle<uint32>* triangle = mesh.getTriangles();
+	for (int t = 0; t < mesh.getTriangleCount(); t++) {
+		int index[3];
+		for (int j = 0; j < 3; j++) {
+			index[j] = getVertex(vertex[triangle[t].index[j]].position, offset);
+		}
+		// triangles that collapse once their vertices are merged have no area and no edges
+		if (index[0] == index[1] || index[0] == index[2] || index[1] == index[2]) {
+			continue;
+		}
+		for (int j = 0; j < 3; j++) {
+			int vertex0 = index[j], vertex1 = index[(j + 1) % 3];
+			std::pair<int, int>& use = edgeUse[std::make_pair(std::min(vertex0, vertex1), std::max(vertex0, vertex1))];
+			(vertex0 < vertex1 ? use.first : use.second)++;
+		}
+	}
+}
+
+bool CrackCheck::isUnmatched(int vertex0, int vertex1, const std::pair<int, int>& use) {
+	return std::abs(use.first - use.second) > (isOnBoundary(vertex0, vertex1) ? 1 : 0);
+}
+
+// an unmatched edge is open when a triangle is missing on one side, and miswound when the triangles on both
+// sides run along it in the same direction
+int CrackCheck::countOpenEdges() {
+	int openEdgeCount = 0;
+	for (std::map<std::pair<int, int>, std::pair<int, int>>::iterator edge = edgeUse.begin(); edge != edgeUse.end(); edge++) {
+		int useCount = edge->second.first + edge->second.second;
+		if (isUnmatched(edge->first.first, edge->first.second, edge->second) && (useCount & 1) != 0) {
+			openEdgeCount++;
+		}
+	}
+	return openEdgeCount;
+}
+
+int CrackCheck::countMiswoundEdges() {
+	int miswoundEdgeCount = 0;
+	for (std::map<std::pair<int, int>, std::pair<int, int>>::iterator edge = edgeUse.begin(); edge != edgeUse.end(); edge++) {
+		int useCount = edge->second.first + edge->second.second;
+		if (isUnmatched(edge->first.first, edge->first.second, edge->second) && (useCount & 1) == 0) {
+			miswoundEdgeCount++;
+		}
+	}
+	return miswoundEdgeCount;
+}
+
+// the vertices on samples of the plane at position along axis, which are placed on a corner of their edge
+int CrackCheck::countSampleVertices(int axis, int position) {
+	int sampleVertexCount = 0;
+	for (size_t i = 0; i < vertexKey.size(); i++) {
+		bool isOnSample = vertexKey[i][axis] == (long)position * 4096;
+		for (int a = 0; a < 3; a++) {
+			isOnSample = isOnSample && (vertexKey[i][a] % 4096) == 0;
+		}
+		sampleVertexCount += isOnSample ? 1 : 0;
+	}
+	return sampleVertexCount;
+}
+
+VolumetricData<int8> sampleField(FieldFunction& field, float sampleScale, const int size[3]) {
+	VolumetricData<int8> data(size[0], size[1], size[2]);
+	for (int i = 0; i < size[0]; i++) {
+		int8* slice = data.getWritableSlice(i);
+		for (int j = 0; j < size[1]; j++) {
+			for (int k = 0; k < size[2]; k++) {
+				long value = std::lround(std::max(-127.0f, std::min(127.0f, field.evaluate((float)i, (float)j, (float)k) * sampleScale)));
+				slice[j * size[2] + k] = (int8)value;
+			}
+		}
+	}
+	return data;
+}
+
+// the coarse chunk has the transition face, its neighbor across it is marched at lod - 1. if hasSampleVertices,
+// the surface must also pass right through samples of the face between the chunks
+bool checkChunkPair(const char* fieldName, FieldFunction& field, float sampleScale, bool hasSampleVertices, int lod, int face) {
+	int axis = face >> 1;
+	bool isPositive = (face & 1) != 0;
+	int size[3] = { CHUNK_CUBE_COUNT + 1, CHUNK_CUBE_COUNT + 1, CHUNK_CUBE_COUNT + 1 };
+	size[axis] += CHUNK_CUBE_COUNT;
+	VolumetricData<int8> data = sampleField(field, sampleScale, size);
+	int coarseOffset[3] = { 0, 0, 0 }, fineOffset[3] = { 0, 0, 0 };
+	(isPositive ? fineOffset : coarseOffset)[axis] = CHUNK_CUBE_COUNT;
+	int chunkSize = CHUNK_CUBE_COUNT + 1;
+	LodGeometry<uint32> coarse(Vector3D(1, 1, 1), data.getView().getSubView(coarseOffset[0], coarseOffset[1], coarseOffset[2], chunkSize, chunkSize, chunkSize), lod, 1 << face);
+	LodGeometry<uint32> fine(Vector3D(1, 1, 1), data.getView().getSubView(fineOffset[0], fineOffset[1], fineOffset[2], chunkSize, chunkSize, chunkSize), lod - 1);
+	CrackCheck check(size);
+	check.addMesh(coarse, coarseOffset);
+	check.addMesh(fine, fineOffset);
+	int openEdgeCount = check.countOpenEdges();
+	int miswoundEdgeCount = check.countMiswoundEdges();
+	int sampleVertexCount = check.countSampleVertices(axis, CHUNK_CUBE_COUNT);
+	// a face the surface doesn't cross checks nothing
+	bool isPassed = coarse.getTransitionTriangleCount() > 0 && (!hasSampleVertices || sampleVertexCount > 0) && openEdgeCount == 0 && miswoundEdgeCount == 0;
+	printf("%-7s lod %d %c%c: %5d transition triangles, %3d vertices on samples, %d open edges, %d miswound edges%s\n", fieldName, lod, isPositive ? '+' : '-', "xyz"[axis],
+		coarse.getTransitionTriangleCount(), sampleVertexCount, openEdgeCount, miswoundEdgeCount, isPassed ? "" : "  FAILED");
+	return isPassed;
+}
+
+int main() {
+	try {
+		float center = CHUNK_CUBE_COUNT * 0.5f;
+		// off the lattice, and crossing the face between the chunks of every pair
+		SphereField sphere(center + 0.3f, center - 0.2f, center + 0.1f, CHUNK_CUBE_COUNT * 0.7f);
+		// on the lattice, with samples right at the iso-value on the face between the chunks, at the samples of
+		// both strides: 6 samples from the center of the face along its axes
+		SphereField latticeSphere(center, center, center, 10);
+		NoiseField noise(6, 7);
+		bool isPassed = true;
+		for (int lod = 1; lod <= 2; lod++) {
+			for (int face = 0; face < 6; face++) {
+				isPassed = checkChunkPair("sphere", sphere, 16, false, lod, face) && isPassed;
+				isPassed = checkChunkPair("lattice", latticeSphere, 4, true, lod, face) && isPassed;
+				isPassed = checkChunkPair("noise", noise, 160, false, lod, face) && isPassed;
+			}
+		}
+		return isPassed ? 0 : 1;
+	}
+	catch (const std::exception& exception) {
+		fprintf(stderr, "%s\n", exception.what());
+		return 1;
+	}
+}
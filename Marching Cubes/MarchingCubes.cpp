@@ -1,4 +1,43 @@
 #include "MarchingCubes.h"
+#include <thread>
+#include <exception>
+#include <unordered_map>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <limits>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#if defined(MARCHING_CUBES_STATS) && defined(__linux__)
+#define MARCHING_CUBES_PERF_EVENTS
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MARCHING_CUBES_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(MARCHING_CUBES_SSE2) && (defined(_MSC_VER) || defined(__GNUC__))
+#define MARCHING_CUBES_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MARCHING_CUBES_TARGET_AVX2
+#else
+#define MARCHING_CUBES_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
 
 Vector3D::Vector3D(int _x, int _y, int _z) {
 	this->x = _x;
@@ -6,256 +45,3181 @@ Vector3D::Vector3D(int _x, int _y, int _z) {
 	this->z = _z;
 }
 
-Vector3D::Vector3D(const Vector3D& v) {
-	this->x = v.x;
-	this->y = v.y;
-	this->z = v.z;
+Vector3D::Vector3D(const Vector3D& v) {
+	this->x = v.x;
+	this->y = v.y;
+	this->z = v.z;
+}
+
+const char VolumeFileHeader::MAGIC[4] = { 'M', 'C', 'V', 'D' };
+
+static_assert(sizeof(VolumeFileHeader) == 64, "VolumeFileHeader must be 64 bytes");
+
+VolumeFileHeader::VolumeFileHeader() {
+	memset(this, 0, sizeof(VolumeFileHeader));
+	memcpy(magic, MAGIC, sizeof(magic));
+	version = VERSION;
+}
+
+bool VolumeFileHeader::hasValidMagic() {
+	return memcmp(magic, MAGIC, sizeof(magic)) == 0;
+}
+
+void VolumeFileHeader::validate(VolumeSampleType _sampleType, uint64 fileByteCount, uint64 sampleSize) {
+	if (!hasValidMagic() || version != VERSION) {
+		throw std::runtime_error("Not a VolumetricData binary file");
+	}
+	if (sampleType != _sampleType) {
+		throw std::runtime_error("Sample type of the VolumetricData binary file doesn't match");
+	}
+	if (sizeX <= 0 || sizeY <= 0 || sizeZ <= 0) {
+		throw std::runtime_error("Invalid dimentions in VolumetricData binary file");
+	}
+	if (layout != VOLUME_LAYOUT_XYZ && layout != VOLUME_LAYOUT_ZYX) {
+		throw std::runtime_error("Unknown layout in VolumetricData binary file");
+	}
+	if (compression != VOLUME_COMPRESSION_NONE && compression != VOLUME_COMPRESSION_RLE) {
+		throw std::runtime_error("Unknown compression in VolumetricData binary file");
+	}
+	if (dataOffset % sampleSize != 0 || dataOffset > fileByteCount || dataByteCount > fileByteCount - dataOffset) {
+		throw std::runtime_error("VolumetricData binary file is truncated");
+	}
+	if (compression == VOLUME_COMPRESSION_NONE && dataByteCount != (uint64)sizeX * sizeY * sizeZ * sampleSize) {
+		throw std::runtime_error("VolumetricData binary file is truncated");
+	}
+}
+
+#ifdef _WIN32
+MappedFile::MappedFile(const char filename[]) {
+	address = NULL;
+	mappingHandle = NULL;
+	fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Can't open file");
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(fileHandle, &size) || size.QuadPart == 0) {
+		CloseHandle(fileHandle);
+		throw std::runtime_error("Can't map an empty file");
+	}
+	byteCount = size.QuadPart;
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if (mappingHandle != NULL) {
+		address = (uint8*)MapViewOfFile(mappingHandle, FILE_MAP_COPY, 0, 0, 0);
+	}
+	if (address == NULL) {
+		if (mappingHandle != NULL) {
+			CloseHandle(mappingHandle);
+		}
+		CloseHandle(fileHandle);
+		throw std::runtime_error("Can't map file");
+	}
+}
+
+MappedFile::~MappedFile() {
+	UnmapViewOfFile(address);
+	CloseHandle(mappingHandle);
+	CloseHandle(fileHandle);
+}
+#else
+MappedFile::MappedFile(const char filename[]) {
+	fileDescriptor = open(filename, O_RDONLY);
+	if (fileDescriptor < 0) {
+		throw std::runtime_error("Can't open file");
+	}
+	struct stat fileStat;
+	if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0) {
+		close(fileDescriptor);
+		throw std::runtime_error("Can't map an empty file");
+	}
+	byteCount = fileStat.st_size;
+	void* mapping = mmap(NULL, byteCount, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileDescriptor, 0);
+	if (mapping == MAP_FAILED) {
+		close(fileDescriptor);
+		throw std::runtime_error("Can't map file");
+	}
+	address = (uint8*)mapping;
+}
+
+MappedFile::~MappedFile() {
+	munmap(address, byteCount);
+	close(fileDescriptor);
+}
+#endif
+
+uint8* MappedFile::getData() {
+	return address;
+}
+
+int64 MappedFile::getByteCount() {
+	return byteCount;
+}
+
+void FieldFunction::evaluateRow(int x, int y, int z, int count, float value[]) {
+	for (int i = 0; i < count; i++) {
+		value[i] = evaluate((float)x, (float)y, (float)(z + i));
+	}
+}
+
+CallbackField::CallbackField(std::function<float(float, float, float)> _fieldFunction) {
+	fieldFunction = _fieldFunction;
+}
+
+float CallbackField::evaluate(float x, float y, float z) {
+	return fieldFunction(x, y, z);
+}
+
+// collects small writes in a large buffer and writes it to the file in big blocks, instead of formatting
+// through the stream and flushing every line
+class BufferedWriter
+{
+private:
+	const static size_t BUFFER_SIZE = 1 << 20;
+	std::ofstream fout;
+	std::vector<char> buffer;
+	size_t usedByteCount;
+public:
+	BufferedWriter(const char filename[]);
+	void write(const void* data, size_t byteCount);
+	void writeText(const char text[]);
+	void writeInt(int64 value);
+	void writeFloat(float value);
+	void flush();
+	// flushes the buffer and throws if anything failed to be written
+	void close();
+};
+
+BufferedWriter::BufferedWriter(const char filename[]) : fout(filename, std::ios::binary) {
+	if (!fout.is_open()) {
+		throw std::runtime_error("Can't open file");
+	}
+	buffer.resize(BUFFER_SIZE);
+	usedByteCount = 0;
+}
+
+void BufferedWriter::write(const void* data, size_t byteCount) {
+	if (usedByteCount + byteCount > BUFFER_SIZE) {
+		flush();
+		if (byteCount > BUFFER_SIZE) {
+			fout.write((const char*)data, byteCount);
+			return;
+		}
+	}
+	memcpy(buffer.data() + usedByteCount, data, byteCount);
+	usedByteCount += byteCount;
+}
+
+void BufferedWriter::writeText(const char text[]) {
+	write(text, strlen(text));
+}
+
+void BufferedWriter::writeInt(int64 value) {
+	char digits[24];
+	int digitCount = 0;
+	uint64 magnitude = (value < 0) ? (uint64)0 - (uint64)value : (uint64)value;
+	do {
+		digits[sizeof(digits) - 1 - digitCount++] = '0' + (char)(magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude > 0);
+	if (value < 0) {
+		digits[sizeof(digits) - 1 - digitCount++] = '-';
+	}
+	write(digits + sizeof(digits) - digitCount, digitCount);
+}
+
+// same text as writing the float to a stream with the default precision
+void BufferedWriter::writeFloat(float value) {
+	char text[32];
+	int length = snprintf(text, sizeof(text), "%g", value);
+	write(text, length);
+}
+
+void BufferedWriter::flush() {
+	fout.write(buffer.data(), usedByteCount);
+	usedByteCount = 0;
+}
+
+void BufferedWriter::close() {
+	flush();
+	fout.close();
+	if (fout.fail()) {
+		throw std::runtime_error("Can't write file");
+	}
+}
+
+bool isBinaryVolumeFile(const char filename[]) {
+	std::ifstream fin(filename, std::ios::binary);
+	if (!fin.is_open()) {
+		return false;
+	}
+	char magic[4];
+	fin.read(magic, sizeof(magic));
+	return fin.gcount() == sizeof(magic) && memcmp(magic, VolumeFileHeader::MAGIC, sizeof(magic)) == 0;
+}
+
+CubeRange::CubeRange(int _xBegin, int _xEnd, int _yBegin, int _yEnd, int _zBegin, int _zEnd) {
+	xBegin = _xBegin;
+	xEnd = _xEnd;
+	yBegin = _yBegin;
+	yEnd = _yEnd;
+	zBegin = _zBegin;
+	zEnd = _zEnd;
+}
+
+MarchingSettings::MarchingSettings(int _threadCount) {
+	this->threadCount = _threadCount;
+	this->skipEmptyBricks = false;
+	this->computeNormals = false;
+	this->isoValue = 0;
+	this->compactVertices = false;
+}
+
+MarchingStats::MarchingStats() {
+#ifdef MARCHING_CUBES_STATS
+	isEnabled = true;
+#else
+	isEnabled = false;
+#endif
+	for (int i = 0; i < CASE_COUNT; i++) {
+		caseCount[i] = 0;
+	}
+	emptyCubeCount = 0;
+	reusedCornerVertexCount = 0;
+	newCornerVertexCount = 0;
+	reusedEdgeVertexCount = 0;
+	newEdgeVertexCount = 0;
+	degenerateTriangleCount = 0;
+	loadSeconds = 0;
+	countSeconds = 0;
+	classifySeconds = 0;
+	emitSeconds = 0;
+	writeSeconds = 0;
+	cycleCount = -1;
+	instructionCount = -1;
+	cacheReferenceCount = -1;
+	cacheMissCount = -1;
+}
+
+// a hardware counter is -1 until one of the threads could read it
+static void addHardwareCount(int64& count, int64 addedCount) {
+	if (addedCount >= 0) {
+		count = (count < 0) ? addedCount : count + addedCount;
+	}
+}
+
+void MarchingStats::add(const MarchingStats& stats) {
+	for (int i = 0; i < CASE_COUNT; i++) {
+		caseCount[i] += stats.caseCount[i];
+	}
+	emptyCubeCount += stats.emptyCubeCount;
+	reusedCornerVertexCount += stats.reusedCornerVertexCount;
+	newCornerVertexCount += stats.newCornerVertexCount;
+	reusedEdgeVertexCount += stats.reusedEdgeVertexCount;
+	newEdgeVertexCount += stats.newEdgeVertexCount;
+	degenerateTriangleCount += stats.degenerateTriangleCount;
+	loadSeconds += stats.loadSeconds;
+	countSeconds += stats.countSeconds;
+	classifySeconds += stats.classifySeconds;
+	emitSeconds += stats.emitSeconds;
+	writeSeconds += stats.writeSeconds;
+	addHardwareCount(cycleCount, stats.cycleCount);
+	addHardwareCount(instructionCount, stats.instructionCount);
+	addHardwareCount(cacheReferenceCount, stats.cacheReferenceCount);
+	addHardwareCount(cacheMissCount, stats.cacheMissCount);
+}
+
+std::string MarchingStats::toJson() const {
+	char buffer[512];
+	std::string json = "{";
+	snprintf(buffer, sizeof(buffer), "\"enabled\": %s, \"emptyCubes\": %lld, \"degenerateTriangles\": %lld, ", isEnabled ? "true" : "false", (long long)emptyCubeCount, (long long)degenerateTriangleCount);
+	json += buffer;
+	snprintf(buffer, sizeof(buffer), "\"vertices\": {\"reusedCorner\": %lld, \"newCorner\": %lld, \"reusedEdge\": %lld, \"newEdge\": %lld}, ",
+		(long long)reusedCornerVertexCount, (long long)newCornerVertexCount, (long long)reusedEdgeVertexCount, (long long)newEdgeVertexCount);
+	json += buffer;
+	snprintf(buffer, sizeof(buffer), "\"seconds\": {\"load\": %.6f, \"count\": %.6f, \"classify\": %.6f, \"emit\": %.6f, \"write\": %.6f}, ",
+		loadSeconds, countSeconds, classifySeconds, emitSeconds, writeSeconds);
+	json += buffer;
+	snprintf(buffer, sizeof(buffer), "\"hardware\": {\"cycles\": %lld, \"instructions\": %lld, \"cacheReferences\": %lld, \"cacheMisses\": %lld}, ",
+		(long long)cycleCount, (long long)instructionCount, (long long)cacheReferenceCount, (long long)cacheMissCount);
+	json += buffer;
+	json += "\"caseHistogram\": [";
+	for (int i = 0; i < CASE_COUNT; i++) {
+		snprintf(buffer, sizeof(buffer), (i == 0) ? "%lld" : ", %lld", (long long)caseCount[i]);
+		json += buffer;
+	}
+	json += "]}";
+	return json;
+}
+
+void MarchingStats::toJsonFile(const char filename[]) const {
+	std::ofstream file(filename);
+	if (!file.is_open()) {
+		throw std::runtime_error("Can't open the stats file");
+	}
+	file << toJson() << std::endl;
+}
+
+#ifdef MARCHING_CUBES_STATS
+static double getStatsSeconds() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+// hardware counters of the calling thread, from when it is created until stop. a counter that can't be
+// opened (no perf_event_open, or forbidden by perf_event_paranoid) is left at -1
+class HardwareCounters
+{
+private:
+	const static int COUNTER_COUNT = 4;
+	int fileDescriptor[COUNTER_COUNT];
+public:
+	HardwareCounters();
+	~HardwareCounters();
+	void stop(MarchingStats& stats);
+};
+
+HardwareCounters::HardwareCounters() {
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		fileDescriptor[i] = -1;
+	}
+#ifdef MARCHING_CUBES_PERF_EVENTS
+	const static uint64 config[COUNTER_COUNT] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES };
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		perf_event_attr attribute;
+		memset(&attribute, 0, sizeof(attribute));
+		attribute.size = sizeof(attribute);
+		attribute.type = PERF_TYPE_HARDWARE;
+		attribute.config = config[i];
+		attribute.disabled = 1;
+		attribute.exclude_kernel = 1;
+		attribute.exclude_hv = 1;
+		fileDescriptor[i] = (int)syscall(__NR_perf_event_open, &attribute, 0, -1, -1, 0);
+		if (fileDescriptor[i] >= 0) {
+			ioctl(fileDescriptor[i], PERF_EVENT_IOC_RESET, 0);
+			ioctl(fileDescriptor[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+#endif
+}
+
+HardwareCounters::~HardwareCounters() {
+#ifdef MARCHING_CUBES_PERF_EVENTS
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		if (fileDescriptor[i] >= 0) {
+			close(fileDescriptor[i]);
+		}
+	}
+#endif
+}
+
+void HardwareCounters::stop(MarchingStats& stats) {
+#ifdef MARCHING_CUBES_PERF_EVENTS
+	int64* count[COUNTER_COUNT] = { &stats.cycleCount, &stats.instructionCount, &stats.cacheReferenceCount, &stats.cacheMissCount };
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		long long value;
+		if (fileDescriptor[i] < 0) {
+			continue;
+		}
+		ioctl(fileDescriptor[i], PERF_EVENT_IOC_DISABLE, 0);
+		if (read(fileDescriptor[i], &value, sizeof(value)) == sizeof(value)) {
+			addHardwareCount(*count[i], value);
+		}
+	}
+#else
+	(void)stats;
+#endif
+}
+
+MeshingContext::MeshingContext() {
+	isInUse = false;
+}
+
+MeshingContext::~MeshingContext() {
+	for (size_t i = 0; i < memory.size(); i++) {
+		free(memory[i]);
+	}
+}
+
+// grows by half again at least, so chunks whose meshes vary a little in size settle on arrays that fit all
+void* MeshingContext::reserve(int set, Array array, int64 byteCount) {
+	size_t index = (size_t)set * ARRAY_COUNT + array;
+	if (index >= memory.size()) {
+		memory.resize(index + 1, NULL);
+		capacity.resize(index + 1, 0);
+	}
+	if (capacity[index] < byteCount) {
+		int64 newCapacity = std::max(byteCount, capacity[index] + capacity[index] / 2);
+		free(memory[index]);
+		memory[index] = malloc(newCapacity);
+		if (memory[index] == NULL) {
+			capacity[index] = 0;
+			throw std::runtime_error("Can't allocate memory in MeshingContext");
+		}
+		capacity[index] = newCapacity;
+	}
+	return memory[index];
+}
+
+int64 MeshingContext::getByteCount() {
+	int64 byteCount = 0;
+	for (size_t i = 0; i < capacity.size(); i++) {
+		byteCount += capacity[i];
+	}
+	return byteCount;
+}
+
+void MeshingContext::clear() {
+	if (isInUse) {
+		throw std::runtime_error("Can't clear a MeshingContext used by a MarchedGeometry");
+	}
+	for (size_t i = 0; i < memory.size(); i++) {
+		free(memory[i]);
+	}
+	memory.clear();
+	capacity.clear();
+}
+
+template<typename IndexType, typename SampleType>
+MarchedGeometry<IndexType, SampleType>::MarchingSlab::MarchingSlab() {
+	contextSet = 0;
+	vertexCount = 0;
+	triangleCount = 0;
+	vertexOffset = 0;
+	vertexCapacity = 0;
+	triangleCapacity = 0;
+	vertex = NULL;
+	triangle = NULL;
+	normal = NULL;
+}
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::initialize(Vector3D cubeScale, int sizeX, int sizeY, int sizeZ, CubeRange range, MarchingSettings settings)
+{
+	this->cubeScale = cubeScale;
+	this->settings = settings;
+	cubeCountX = sizeX - 1;
+	cubeCountY = sizeY - 1;
+	cubeCountZ = sizeZ - 1;
+	if (range.xBegin < 0 || range.xBegin > range.xEnd || range.xEnd > std::max(cubeCountX, 0) ||
+		range.yBegin < 0 || range.yBegin > range.yEnd || range.yEnd > std::max(cubeCountY, 0) ||
+		range.zBegin < 0 || range.zBegin > range.zEnd || range.zEnd > std::max(cubeCountZ, 0)) {
+		throw std::runtime_error("Cube range out of bound in MarchedGeometry");
+	}
+	this->range = range;
+	if (!getIsoThreshold(settings.isoValue, isoThreshold)) {
+		// every cube is inside, there is no surface to march
+		this->range = CubeRange(range.xBegin, range.xBegin, range.yBegin, range.yBegin, range.zBegin, range.zBegin);
+	}
+	isIsoValueASample = ((double)isoThreshold == settings.isoValue);
+	this->size = Vector3D(cubeScale.x * cubeCountX, cubeScale.y * cubeCountY, cubeScale.z * cubeCountZ);
+	field = VolumetricView<SampleType>();
+	fieldOffsetX = 0;
+	vertexCount = 0;
+	triangleCount = 0;
+	vertex = NULL;
+	triangle = NULL;
+	normal = NULL;
+	compactVertex = NULL;
+	compactVertexScale = Vector3D();
+	compactVertexOffset = Vector3D();
+	allocatedByteCount = 0;
+	peakByteCount = 0;
+	brickSummary = NULL;
+	context = NULL;
+	isMeshInContext = false;
+}
+
+template<typename IndexType, typename SampleType>
+MarchedGeometry<IndexType, SampleType>::MarchedGeometry(Vector3D cubeScale, VolumetricView<SampleType> _field, MarchingSettings settings)
+{
+	int cubeCountX = std::max(_field.getSizeX() - 1, 0);
+	int cubeCountY = std::max(_field.getSizeY() - 1, 0);
+	int cubeCountZ = std::max(_field.getSizeZ() - 1, 0);
+	initialize(cubeScale, _field.getSizeX(), _field.getSizeY(), _field.getSizeZ(), CubeRange(0, cubeCountX, 0, cubeCountY, 0, cubeCountZ), settings);
+	marchField(_field);
+}
+
+template<typename IndexType, typename SampleType>
+MarchedGeometry<IndexType, SampleType>::MarchedGeometry(Vector3D cubeScale, VolumetricView<SampleType> _field, CubeRange range, MarchingSettings settings)
+{
+	initialize(cubeScale, _field.getSizeX(), _field.getSizeY(), _field.getSizeZ(), range, settings);
+	marchField(_field);
+}
+
+template<typename IndexType, typename SampleType>
+MarchedGeometry<IndexType, SampleType>::MarchedGeometry(Vector3D cubeScale, VolumetricView<SampleType> _field, MarchingSettings settings, MeshingContext& context)
+	: MarchedGeometry(cubeScale, _field, CubeRange(0, std::max(_field.getSizeX() - 1, 0), 0, std::max(_field.getSizeY() - 1, 0), 0, std::max(_field.getSizeZ() - 1, 0)), settings, context)
+{
+}
+
+template<typename IndexType, typename SampleType>
+MarchedGeometry<IndexType, SampleType>::MarchedGeometry(Vector3D cubeScale, VolumetricView<SampleType> _field, CubeRange range, MarchingSettings settings, MeshingContext& context)
+	: MarchedGeometry(cubeScale, _field, range, settings, context, true)
+{
+}
+
+// the context is only taken once the mesh is in it, a geometry that fails to march leaves it free. a mesh
+// not kept in the context is allocated as without one, and only the scratch memory comes from the context
+template<typename IndexType, typename SampleType>
+MarchedGeometry<IndexType, SampleType>::MarchedGeometry(Vector3D cubeScale, VolumetricView<SampleType> _field, CubeRange range, MarchingSettings settings, MeshingContext& _context, bool _isMeshInContext)
+{
+	if (_context.isInUse) {
+		throw std::runtime_error("MeshingContext is still used by another MarchedGeometry");
+	}
+	initialize(cubeScale, _field.getSizeX(), _field.getSizeY(), _field.getSizeZ(), range, settings);
+	context = &_context;
+	isMeshInContext = _isMeshInContext;
+	marchField(_field);
+	if (isMeshInContext) {
+		context->isInUse = true;
+	}
+	else {
+		context = NULL;
+	}
+}
+
+template<typename IndexType, typename SampleType>
+MarchedGeometry<IndexType, SampleType>::MarchedGeometry(Vector3D cubeScale, VolumeSliceSource<SampleType>& source, MarchingSettings settings)
+{
+	int cubeCountX = std::max(source.getSizeX() - 1, 0);
+	int cubeCountY = std::max(source.getSizeY() - 1, 0);
+	int cubeCountZ = std::max(source.getSizeZ() - 1, 0);
+	initialize(cubeScale, source.getSizeX(), source.getSizeY(), source.getSizeZ(), CubeRange(0, cubeCountX, 0, cubeCountY, 0, cubeCountZ), settings);
+}
+
+// the field is only referenced while marching, the generated mesh doesn't keep it
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::marchField(VolumetricView<SampleType> _field)
+{
+	field = _field;
+	if (settings.skipEmptyBricks) {
+		MARCHING_CUBES_STATS_ONLY(double loadBegin = getStatsSeconds());
+		brickSummary = new BrickSummary<SampleType>(_field, BrickSummary<SampleType>::DEFAULT_BRICK_SIZE, isoThreshold);
+		MARCHING_CUBES_STATS_ONLY(stats.loadSeconds += getStatsSeconds() - loadBegin);
+	}
+	try {
+		marchCubes();
+	}
+	catch (...) {
+		delete brickSummary;
+		brickSummary = NULL;
+		field = VolumetricView<SampleType>();
+		throw;
+	}
+	field = VolumetricView<SampleType>();
+	if (settings.compactVertices) {
+		compactVertices();
+	}
+}
+
+template<typename IndexType, typename SampleType>
+MarchedGeometry<IndexType, SampleType>::MarchedGeometry()
+{
+	initialize(Vector3D(), 0, 0, 0, CubeRange(), MarchingSettings());
+}
+
+template<typename IndexType, typename SampleType>
+MarchedGeometry<IndexType, SampleType>::MarchedGeometry(MarchedGeometry&& geometry)
+{
+	vertex = NULL;
+	triangle = NULL;
+	normal = NULL;
+	compactVertex = NULL;
+	brickSummary = NULL;
+	context = NULL;
+	moveFrom(geometry);
+}
+
+template<typename IndexType, typename SampleType>
+MarchedGeometry<IndexType, SampleType>& MarchedGeometry<IndexType, SampleType>::operator=(MarchedGeometry&& geometry)
+{
+	if (this != &geometry) {
+		releaseMesh();
+		moveFrom(geometry);
+	}
+	return *this;
+}
+
+// takes the arrays of geometry and leaves it with an empty mesh
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::moveFrom(MarchedGeometry& geometry)
+{
+	cubeScale = geometry.cubeScale;
+	size = geometry.size;
+	field = VolumetricView<SampleType>();
+	isoThreshold = geometry.isoThreshold;
+	isIsoValueASample = geometry.isIsoValueASample;
+	fieldOffsetX = 0;
+	range = geometry.range;
+	vertexCount = geometry.vertexCount;
+	triangleCount = geometry.triangleCount;
+	vertex = geometry.vertex;
+	triangle = geometry.triangle;
+	normal = geometry.normal;
+	compactVertex = geometry.compactVertex;
+	compactVertexScale = geometry.compactVertexScale;
+	compactVertexOffset = geometry.compactVertexOffset;
+	cubeCountX = geometry.cubeCountX;
+	cubeCountY = geometry.cubeCountY;
+	cubeCountZ = geometry.cubeCountZ;
+	settings = geometry.settings;
+	brickSummary = geometry.brickSummary;
+	context = geometry.context;
+	isMeshInContext = geometry.isMeshInContext;
+	allocatedByteCount = geometry.allocatedByteCount.load();
+	peakByteCount = geometry.peakByteCount.load();
+	stats = geometry.stats;
+	geometry.vertexCount = 0;
+	geometry.triangleCount = 0;
+	geometry.vertex = NULL;
+	geometry.triangle = NULL;
+	geometry.normal = NULL;
+	geometry.compactVertex = NULL;
+	geometry.brickSummary = NULL;
+	geometry.context = NULL;
+	geometry.allocatedByteCount = 0;
+}
+
+// the arrays of a geometry with a context belong to the context, which is only given back
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::releaseMesh()
+{
+	if (context != NULL) {
+		context->isInUse = false;
+	}
+	else {
+		free(vertex);
+		free(triangle);
+		free(normal);
+		free(compactVertex);
+	}
+	delete brickSummary;
+}
+
+template<typename IndexType, typename SampleType>
+MarchedGeometry<IndexType, SampleType>::~MarchedGeometry()
+{
+	releaseMesh();
+}
+
+// row[i] is the row of the field at (x + (i & 1), y + (i >> 1)), so the 4 rows hold every corner of the
+// cubes at (x, y) and corner values can be read with plain offsets instead of checked field lookups
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::getRows(int x, int y, const SampleType* row[4]) {
+	for (int i = 0; i < 4; i++) {
+		row[i] = field.getRow(x - fieldOffsetX + (i & 1), y + (i >> 1));
+	}
+}
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::getCornerFieldValues(const SampleType* row[4], int z, SampleType cornerValue[CORNER_COUNT]) {
+	for (int i = 0; i < CORNER_COUNT; i++) {
+		cornerValue[i] = row[i & 3][z + (i >> 2)];
+	}
+}
+
+// same as classifyRow for the cubes [zBegin, zEnd) of the row at (x, y), but the runs of cubes in uniform
+// bricks are set to case 0 without reading their samples
+template<typename IndexType, typename SampleType>
+bool MarchedGeometry<IndexType, SampleType>::classifyActiveRow(int x, int y, int zBegin, int zEnd, const SampleType* row[4], RowClassifier classifyRow, uint8 caseIndexRow[]) {
+	if (brickSummary == NULL) {
+		const SampleType* rangeRow[4] = { row[0] + zBegin, row[1] + zBegin, row[2] + zBegin, row[3] + zBegin };
+		return classifyRow(rangeRow, zEnd - zBegin, isoThreshold, caseIndexRow + zBegin);
+	}
+	int brickSize = brickSummary->getBrickSize();
+	bool isAnyCubeActive = false;
+	int runBegin = zBegin;
+	for (int brickZ = zBegin / brickSize; ; brickZ++) {
+		int brickBegin = std::max(brickZ * brickSize, zBegin);
+		bool isEnd = (brickBegin >= zEnd);
+		if (!isEnd && !brickSummary->isUniform(x / brickSize, y / brickSize, brickZ)) {
+			continue;
+		}
+		// classify the run of non-uniform bricks before this one at once, to keep the vector loops busy
+		int runEnd = std::min(brickBegin, zEnd);
+		if (runEnd > runBegin) {
+			const SampleType* runRow[4] = { row[0] + runBegin, row[1] + runBegin, row[2] + runBegin, row[3] + runBegin };
+			isAnyCubeActive |= classifyRow(runRow, runEnd - runBegin, isoThreshold, caseIndexRow + runBegin);
+		}
+		if (isEnd) {
+			break;
+		}
+		int brickEnd = std::min((brickZ + 1) * brickSize, zEnd);
+		memset(caseIndexRow + brickBegin, 0, brickEnd - brickBegin);
+		runBegin = brickEnd;
+	}
+	return isAnyCubeActive;
+}
+
+// the deltas to older cubes allowed for a cube x, y and z cubes after the first of the slab, computed once
+// per cube with comparisons instead of branches
+template<typename IndexType, typename SampleType>
+uint32 MarchedGeometry<IndexType, SampleType>::getCornerDeltaMask(int x, int y, int z)
+{
+	return (uint32)(x != 0) | ((uint32)(y != 0) << 1) | ((uint32)(z != 0) << 2);
+}
+
+template<typename IndexType, typename SampleType>
+uint32 MarchedGeometry<IndexType, SampleType>::getEdgeDeltaMask(int x, int y, int z)
+{
+	return (uint32)(x != 0) | ((uint32)(y != 0) * 6) | ((uint32)(z != 0) << 3);
+}
+
+// through the reciprocal of the distance between the two samples. distance1 and distance1 - distance0 have
+// the same sign, so their absolute values are divided
+inline int32 MarchingCubesTables::getByteInterpolationT(int32 distance0, int32 distance1)
+{
+	uint64 dividend = (uint64)std::abs(distance1) * 0x0100;
+	return (int32)((dividend * interpolationReciprocal[std::abs(distance1 - distance0)]) >> INTERPOLATION_RECIPROCAL_SHIFT);
+}
+
+// the corners are on both sides of the iso-value, so the distances to it have opposite signs and never
+// divide by zero. interpolationT is 0 when the higher numbered corner is right at the iso-value
+template<typename IndexType, typename SampleType>
+typename MarchedGeometry<IndexType, SampleType>::InterpolationType MarchedGeometry<IndexType, SampleType>::getInterpolationT(SampleType fieldValue0, SampleType fieldValue1)
+{
+	if constexpr (std::is_floating_point<SampleType>::value) {
+		float distance0 = fieldValue0 - settings.isoValue;
+		float distance1 = fieldValue1 - settings.isoValue;
+		return distance1 / (distance1 - distance0);
+	}
+	else {
+		if constexpr (sizeof(SampleType) == 1) {
+			if (isIsoValueASample) {
+				return getByteInterpolationT((int32)fieldValue0 - isoThreshold, (int32)fieldValue1 - isoThreshold);
+			}
+		}
+		// rounded toward zero like an integer division, which it is for an integer iso-value. the double
+		// quotient is exact enough for that up to the 16 fractional bits of int16
+		double distance0 = (double)fieldValue0 - settings.isoValue;
+		double distance1 = (double)fieldValue1 - settings.isoValue;
+		return (int32)(distance1 * INTERPOLATION_ONE / (distance1 - distance0));
+	}
+}
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::ReusableCubeData::reset(int _cubeX) {
+	cubeX = _cubeX;
+	for (int i = 0; i < REUSABLE_CORNER_COUNT; i++) {
+		corner[i] = BLANK;
+	}
+	for (int i = 0; i < REUSABLE_EDGE_COUNT; i++) {
+		edge[i] = BLANK;
+	}
+}
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::ReusableCubeData::setCorner(uint8 cornerIndex, IndexType value) {
+	if (cornerIndex >= (CORNER_COUNT - REUSABLE_CORNER_COUNT)) {
+		corner[cornerIndex - (CORNER_COUNT - REUSABLE_CORNER_COUNT)] = value;
+	}
+}
+
+template<typename IndexType, typename SampleType>
+IndexType MarchedGeometry<IndexType, SampleType>::ReusableCubeData::getCorner(uint8 cornerIndex) {
+	if (cornerIndex >= (CORNER_COUNT - REUSABLE_CORNER_COUNT)) {
+		return corner[cornerIndex - (CORNER_COUNT - REUSABLE_CORNER_COUNT)];
+	}
+	return BLANK;
+}
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::ReusableCubeData::setEdge(uint8 edgeIndex, IndexType value) {
+	if (edgeIndex >= (EDGE_COUNT - REUSABLE_EDGE_COUNT)) {
+		edge[edgeIndex - (EDGE_COUNT - REUSABLE_EDGE_COUNT)] = value;
+	}
+}
+
+template<typename IndexType, typename SampleType>
+IndexType MarchedGeometry<IndexType, SampleType>::ReusableCubeData::getEdge(uint8 edgeIndex) {
+	if (edgeIndex >= (EDGE_COUNT - REUSABLE_EDGE_COUNT)) {
+		return edge[edgeIndex - (EDGE_COUNT - REUSABLE_EDGE_COUNT)];
+	}
+	return BLANK;
+}
+
+template<typename IndexType, typename SampleType>
+MarchedGeometry<IndexType, SampleType>::ReusableCubeDoubleDeck::ReusableCubeDoubleDeck(int _yBegin, int _zBegin, int _cubeCountY, int _cubeCountZ, ReusableCubeData memory[]) {
+	yBegin = _yBegin;
+	zBegin = _zBegin;
+	cubeCountY = _cubeCountY;
+	cubeCountZ = _cubeCountZ;
+	deck[0] = memory;
+	deck[1] = memory + cubeCountY * cubeCountZ;
+	for (int i = 0; i < cubeCountY * cubeCountZ; i++) {
+		deck[0][i].cubeX = -1;
+		deck[1][i].cubeX = -1;
+	}
+}
+
+template<typename IndexType, typename SampleType>
+typename MarchedGeometry<IndexType, SampleType>::ReusableCubeData& MarchedGeometry<IndexType, SampleType>::ReusableCubeDoubleDeck::get(int x, int y, int z) {
+	ReusableCubeData& reusableCubeData = deck[x & 1][(y - yBegin) * cubeCountZ + (z - zBegin)];
+	if (reusableCubeData.cubeX != x) {
+		reusableCubeData.reset(x);
+	}
+	return reusableCubeData;
+}
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::setVertex(Vertex& vertex, float xPos, float yPos, float zPos)
+{
+	vertex.position.x = xPos;
+	vertex.position.y = yPos;
+	vertex.position.z = zPos;
+	// TODO set tangent, and texcoord
+}
+
+// central differences of the field at the lattice point (x, y, z), one-sided on the border of the volume
+template<typename IndexType, typename SampleType>
+Vector3D MarchedGeometry<IndexType, SampleType>::getGradient(int x, int y, int z)
+{
+	int x0 = std::max(x - 1, 0), x1 = std::min(x + 1, cubeCountX);
+	int y0 = std::max(y - 1, 0), y1 = std::min(y + 1, cubeCountY);
+	int z0 = std::max(z - 1, 0), z1 = std::min(z + 1, cubeCountZ);
+	Vector3D gradient;
+	gradient.x = (field.getUnchecked(x1 - fieldOffsetX, y, z) - field.getUnchecked(x0 - fieldOffsetX, y, z)) / ((x1 - x0) * cubeScale.x);
+	gradient.y = (field.getUnchecked(x - fieldOffsetX, y1, z) - field.getUnchecked(x - fieldOffsetX, y0, z)) / ((y1 - y0) * cubeScale.y);
+	gradient.z = (field.getUnchecked(x - fieldOffsetX, y, z1) - field.getUnchecked(x - fieldOffsetX, y, z0)) / ((z1 - z0) * cubeScale.z);
+	return gradient;
+}
+
+// the field grows outwards, so the normal is the normalized gradient. a zero gradient gives a zero normal
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::setNormal(Vector3D& normal, float xGradient, float yGradient, float zGradient)
+{
+	float length = sqrtf(xGradient * xGradient + yGradient * yGradient + zGradient * zGradient);
+	float scale = (length > 0) ? 1.0f / length : 0.0f;
+	normal.x = xGradient * scale;
+	normal.y = yGradient * scale;
+	normal.z = zGradient * scale;
+}
+
+template<typename IndexType, typename SampleType>
+bool MarchedGeometry<IndexType, SampleType>::isTriangleAreaZero(const Triangle& triangle)
+{
+	if (triangle.index[0] == triangle.index[1]) {
+		return true;
+	}
+	if (triangle.index[0] == triangle.index[2]) {
+		return true;
+	}
+	if (triangle.index[1] == triangle.index[2]) {
+		return true;
+	}
+	return false;
+}
+
+// kind is 0 for a vertex on a lattice corner, 1 for a vertex on a y edge and 2 for a vertex on a z edge
+template<typename IndexType, typename SampleType>
+int64 MarchedGeometry<IndexType, SampleType>::getBoundaryKey(int y, int z, int kind)
+{
+	return ((int64)y * (cubeCountZ + 1) + z) * 3 + kind;
+}
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::recordBoundaryVertex(MarchingSlab& slab, int x, int y, int z, int kind, IndexType vertexIndex)
+{
+	BoundaryVertex boundaryVertex;
+	boundaryVertex.key = getBoundaryKey(y, z, kind);
+	boundaryVertex.vertexIndex = vertexIndex;
+	if (x == slab.range.xBegin && slab.range.xBegin > range.xBegin) {
+		slab.lowerBoundary.push_back(boundaryVertex);
+	}
+	if (x == slab.range.xEnd && slab.range.xEnd < range.xEnd) {
+		slab.upperBoundary.push_back(boundaryVertex);
+	}
+}
+
+template<typename IndexType, typename SampleType>
+IndexType MarchedGeometry<IndexType, SampleType>::getNextVertexIndex(MarchingSlab& slab) {
+	if (slab.vertexCount >= MAX_VERTEX_COUNT) {
+		throw std::runtime_error("Vertex count exceeds the range of the index type in MarchedGeometry, use a wider index type");
+	}
+	return slab.vertexCount++;
+}
+
+template<typename IndexType, typename SampleType>
+IndexType MarchedGeometry<IndexType, SampleType>::getNewVertexIndexOnCorner(int x, int y, int z, uint8 cornerIndex, MarchingSlab& slab) {
+	int cornerX = x + ((cornerIndex >> 0) & 1);
+	int cornerY = y + ((cornerIndex >> 1) & 1);
+	int cornerZ = z + ((cornerIndex >> 2) & 1);
+	IndexType vertexIndex = getNextVertexIndex(slab);
+	setVertex(slab.vertex[vertexIndex - slab.vertexOffset], cubeScale.x * cornerX, cubeScale.y * cornerY, cubeScale.z * cornerZ);
+	if (slab.normal != NULL) {
+		Vector3D gradient = getGradient(cornerX, cornerY, cornerZ);
+		setNormal(slab.normal[vertexIndex - slab.vertexOffset], gradient.x, gradient.y, gradient.z);
+	}
+	recordBoundaryVertex(slab, cornerX, cornerY, cornerZ, 0, vertexIndex);
+	return vertexIndex;
+}
+
+template<typename IndexType, typename SampleType>
+IndexType MarchedGeometry<IndexType, SampleType>::getVertexIndexOnCorner(int x, int y, int z, uint8 cornerIndex, uint32 cornerDeltaMask, ReusableCubeDoubleDeck& deck, MarchingSlab& slab) {
+	uint32 delta = cornerIndex ^ 7;
+	uint32 maskedDelta = delta & cornerDeltaMask;
+	cornerIndex += maskedDelta;
+	x -= ((maskedDelta >> 0) & 1);
+	y -= ((maskedDelta >> 1) & 1);
+	z -= ((maskedDelta >> 2) & 1);
+	ReusableCubeData& reusableCubeData = deck.get(x, y, z);
+	IndexType vertexIndex = reusableCubeData.getCorner(cornerIndex);
+	if (vertexIndex == ReusableCubeData::BLANK) {
+		vertexIndex = getNewVertexIndexOnCorner(x, y, z, cornerIndex, slab);
+		reusableCubeData.setCorner(cornerIndex, vertexIndex);
+		MARCHING_CUBES_STATS_ONLY(slab.stats.newCornerVertexCount++);
+	}
+	else {
+		MARCHING_CUBES_STATS_ONLY(slab.stats.reusedCornerVertexCount++);
+	}
+	return vertexIndex;
+}
+
+template<typename IndexType, typename SampleType>
+IndexType MarchedGeometry<IndexType, SampleType>::getNewVertexIndexOnEdge(int x, int y, int z, uint8 cornerPair, InterpolationType interpolationT, MarchingSlab& slab) {
+	uint8 corner0 = cornerPair & 0x0F, corner1 = cornerPair >> 4;
+	float interpolatedX = (((corner0 >> 0) & 1) * interpolationT + ((corner1 >> 0) & 1) * (INTERPOLATION_ONE - interpolationT)) / (double)INTERPOLATION_ONE;
+	float interpolatedY = (((corner0 >> 1) & 1) * interpolationT + ((corner1 >> 1) & 1) * (INTERPOLATION_ONE - interpolationT)) / (double)INTERPOLATION_ONE;
+	float interpolatedZ = (((corner0 >> 2) & 1) * interpolationT + ((corner1 >> 2) & 1) * (INTERPOLATION_ONE - interpolationT)) / (double)INTERPOLATION_ONE;
+	float xPos = cubeScale.x * (x + interpolatedX);
+	float yPos = cubeScale.y * (y + interpolatedY);
+	float zPos = cubeScale.z * (z + interpolatedZ);
+	IndexType vertexIndex = getNextVertexIndex(slab);
+	setVertex(slab.vertex[vertexIndex - slab.vertexOffset], xPos, yPos, zPos);
+	if (slab.normal != NULL) {
+		// the gradients of the two corners are interpolated with the same weights as the position
+		Vector3D gradient0 = getGradient(x + ((corner0 >> 0) & 1), y + ((corner0 >> 1) & 1), z + ((corner0 >> 2) & 1));
+		Vector3D gradient1 = getGradient(x + ((corner1 >> 0) & 1), y + ((corner1 >> 1) & 1), z + ((corner1 >> 2) & 1));
+		float t0 = interpolationT / (float)INTERPOLATION_ONE, t1 = 1.0f - t0;
+		setNormal(slab.normal[vertexIndex - slab.vertexOffset], gradient0.x * t0 + gradient1.x * t1, gradient0.y * t0 + gradient1.y * t1, gradient0.z * t0 + gradient1.z * t1);
+	}
+	// the lower numbered corner is the lattice point the edge starts from
+	uint8 edgeDirection = corner0 ^ corner1;
+	if (edgeDirection != 1) {
+		int edgeX = x + ((corner0 >> 0) & 1);
+		int edgeY = y + ((corner0 >> 1) & 1);
+		int edgeZ = z + ((corner0 >> 2) & 1);
+		recordBoundaryVertex(slab, edgeX, edgeY, edgeZ, edgeDirection >> 1, vertexIndex);
+	}
+	return vertexIndex;
+}
+
+template<typename IndexType, typename SampleType>
+IndexType MarchedGeometry<IndexType, SampleType>::getVertexIndexOnEdge(int x, int y, int z, uint8 cornerPair, uint8 edgeIndex, uint32 maskedEdgeDelta, InterpolationType interpolationT, ReusableCubeDoubleDeck& deck, MarchingSlab& slab) {
+	edgeIndex += (maskedEdgeDelta & 1) * 3 + ((maskedEdgeDelta >> 1) & 1) * 3 + ((maskedEdgeDelta >> 2) & 1) * 3 + ((maskedEdgeDelta >> 3) & 1) * 6;
+	x -= ((maskedEdgeDelta >> 0) & 1);
+	y -= ((maskedEdgeDelta >> 1) & 1);
+	z -= ((maskedEdgeDelta >> 3) & 1);
+	ReusableCubeData& reusableCubeData = deck.get(x, y, z);
+	IndexType vertexIndex = reusableCubeData.getEdge(edgeIndex);
+	if (vertexIndex == ReusableCubeData::BLANK) {
+		vertexIndex = getNewVertexIndexOnEdge(x, y, z, cornerPair, interpolationT, slab);
+		reusableCubeData.setEdge(edgeIndex, vertexIndex);
+		MARCHING_CUBES_STATS_ONLY(slab.stats.newEdgeVertexCount++);
+	}
+	else {
+		MARCHING_CUBES_STATS_ONLY(slab.stats.reusedEdgeVertexCount++);
+	}
+	return vertexIndex;
+}
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::marchCube(int x, int y, int z, uint32 caseIndex, const SampleType* row[4], ReusableCubeDoubleDeck& deck, MarchingSlab& slab)
+{
+	IndexType cubeVertexIndex[MAX_VERTEX_PER_CUBE];
+	SampleType cornerValue[CORNER_COUNT];
+	getCornerFieldValues(row, z, cornerValue);
+	const CaseGeometry& geometry = caseGeometry[caseIndex];
+	// the first planes of a slab have no reusable data behind them, same as the first planes of the volume
+	uint32 cornerDeltaMask = getCornerDeltaMask(x - slab.range.xBegin, y - slab.range.yBegin, z - slab.range.zBegin);
+	uint32 edgeDeltaMask = getEdgeDeltaMask(x - slab.range.xBegin, y - slab.range.yBegin, z - slab.range.zBegin);
+	for (int i = 0; i < geometry.vertexCount; i++) {
+		uint8 cornerPair = geometry.cornerPair[i];
+		uint8 corner0 = cornerPair & 0x0F, corner1 = cornerPair >> 4;
+		InterpolationType interpolationT = getInterpolationT(cornerValue[corner0], cornerValue[corner1]);
+		if (interpolationT == 0 || interpolationT == INTERPOLATION_ONE) {
+			cubeVertexIndex[i] = getVertexIndexOnCorner(x, y, z, (interpolationT == 0) ? corner1 : corner0, cornerDeltaMask, deck, slab);
+		}
+		else {
+			cubeVertexIndex[i] = getVertexIndexOnEdge(x, y, z, cornerPair, geometry.edgeIndex[i], geometry.edgeDelta[i] & edgeDeltaMask, interpolationT, deck, slab);
+		}
+	}
+	for (int i = 0; i < geometry.triangleCount; i++) {
+		Triangle& newTriangle = slab.triangle[slab.triangleCount];
+		for (int j = 0; j < 3; j++) {
+			newTriangle.index[j] = cubeVertexIndex[geometry.vertexIndex[3 * i + j]];
+		}
+		if (!isTriangleAreaZero(newTriangle)) {
+			slab.triangleCount++;
+		}
+		else {
+			MARCHING_CUBES_STATS_ONLY(slab.stats.degenerateTriangleCount++);
+		}
+	}
+}
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::trackMemory(int64 byteCount)
+{
+	int64 current = (allocatedByteCount += byteCount);
+	int64 peak = peakByteCount;
+	while (current > peak && !peakByteCount.compare_exchange_weak(peak, current)) {
+	}
+}
+
+// the arrays of the mesh are set 0 of the context, and only kept there if the context holds the mesh
+template<typename IndexType, typename SampleType>
+bool MarchedGeometry<IndexType, SampleType>::isInContext(int contextSet, MeshingContext::Array array)
+{
+	if (context == NULL) {
+		return false;
+	}
+	return isMeshInContext || contextSet != 0 || array < MeshingContext::VERTEX;
+}
+
+template<typename IndexType, typename SampleType>
+void* MarchedGeometry<IndexType, SampleType>::allocate(int64 byteCount, int contextSet, MeshingContext::Array array)
+{
+	if (isInContext(contextSet, array)) {
+		trackMemory(byteCount);
+		return context->reserve(contextSet, array, byteCount);
+	}
+	void* memory = malloc(byteCount);
+	if (memory == NULL && byteCount > 0) {
+		throw std::runtime_error("Can't allocate memory in MarchedGeometry");
+	}
+	trackMemory(byteCount);
+	return memory;
+}
+
+template<typename IndexType, typename SampleType>
+void* MarchedGeometry<IndexType, SampleType>::shrink(void* memory, int64 oldByteCount, int64 newByteCount, int contextSet, MeshingContext::Array array)
+{
+	if (isInContext(contextSet, array)) {
+		// the context keeps its arrays at their largest size for the next meshing
+		trackMemory(newByteCount - oldByteCount);
+		return memory;
+	}
+	if (newByteCount == 0) {
+		release(memory, oldByteCount, contextSet, array);
+		return NULL;
+	}
+	void* shrunkMemory = realloc(memory, newByteCount);
+	if (shrunkMemory == NULL) {
+		return memory;
+	}
+	trackMemory(newByteCount - oldByteCount);
+	return shrunkMemory;
+}
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::release(void* memory, int64 byteCount, int contextSet, MeshingContext::Array array)
+{
+	if (!isInContext(contextSet, array)) {
+		free(memory);
+	}
+	trackMemory(-byteCount);
+}
+
+template<typename IndexType, typename SampleType>
+int64 MarchedGeometry<IndexType, SampleType>::countTriangles(CubeRange countRange, uint8 caseIndexRow[])
+{
+	int64 count = 0;
+	RowClassifier classifyRow = getRowClassifier<SampleType>();
+	for (int i = countRange.xBegin; i < countRange.xEnd; i++) {
+		for (int j = countRange.yBegin; j < countRange.yEnd; j++) {
+			const SampleType* row[4];
+			getRows(i, j, row);
+			if (!classifyActiveRow(i, j, countRange.zBegin, countRange.zEnd, row, classifyRow, caseIndexRow)) {
+				continue;
+			}
+			for (int k = countRange.zBegin; k < countRange.zEnd; k++) {
+				count += caseGeometry[caseIndexRow[k]].triangleCount;
+			}
+		}
+	}
+	return count;
+}
+
+// walks the cubes of the plane in the memory order of the field (z contiguous), so consecutive cubes
+// share their corner samples in the same cache lines
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::marchPlane(int x, RowClassifier classifyRow, uint8 caseIndexRow[], ReusableCubeDoubleDeck& deck, MarchingSlab& slab)
+{
+	for (int j = slab.range.yBegin; j < slab.range.yEnd; j++) {
+		const SampleType* row[4];
+		getRows(x, j, row);
+		MARCHING_CUBES_STATS_ONLY(double classifyBegin = getStatsSeconds());
+		bool isRowActive = classifyActiveRow(x, j, slab.range.zBegin, slab.range.zEnd, row, classifyRow, caseIndexRow);
+		MARCHING_CUBES_STATS_ONLY(slab.stats.classifySeconds += getStatsSeconds() - classifyBegin);
+#ifdef MARCHING_CUBES_STATS
+		// the cubes of skipped bricks are set to case 0 without being classified
+		for (int k = slab.range.zBegin; k < slab.range.zEnd; k++) {
+			slab.stats.caseCount[caseIndexRow[k]]++;
+			slab.stats.emptyCubeCount += (caseIndexRow[k] == 0 || caseIndexRow[k] == 0xFF) ? 1 : 0;
+		}
+		if (brickSummary != NULL) {
+			int skippedCubeCount = 0;
+			for (int k = slab.range.zBegin; k < slab.range.zEnd; k++) {
+				skippedCubeCount += brickSummary->isUniform(x / brickSummary->getBrickSize(), j / brickSummary->getBrickSize(), k / brickSummary->getBrickSize()) ? 1 : 0;
+			}
+			slab.stats.caseCount[0] -= skippedCubeCount;
+			slab.stats.emptyCubeCount -= skippedCubeCount;
+		}
+#endif
+		if (!isRowActive) {
+			continue;
+		}
+		MARCHING_CUBES_STATS_ONLY(double emitBegin = getStatsSeconds());
+		for (int k = slab.range.zBegin; k < slab.range.zEnd; k++) {
+			if (caseIndexRow[k] != 0 && caseIndexRow[k] != 0xFF) {
+				marchCube(x, j, k, caseIndexRow[k], row, deck, slab);
+			}
+		}
+		MARCHING_CUBES_STATS_ONLY(slab.stats.emitSeconds += getStatsSeconds() - emitBegin);
+	}
+}
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::marchSlab(MarchingSlab& slab)
+{
+	MARCHING_CUBES_STATS_ONLY(HardwareCounters hardwareCounters);
+	MARCHING_CUBES_STATS_ONLY(double countBegin = getStatsSeconds());
+	int64 caseIndexRowByteCount = cubeCountZ;
+	int deckCubeCountY = slab.range.yEnd - slab.range.yBegin;
+	int deckCubeCountZ = slab.range.zEnd - slab.range.zBegin;
+	int64 deckByteCount = 2 * (int64)deckCubeCountY * deckCubeCountZ * sizeof(ReusableCubeData);
+	uint8* caseIndexRow = (uint8*)allocate(caseIndexRowByteCount, slab.contextSet, MeshingContext::CASE_ROW);
+	ReusableCubeData* deckMemory = NULL;
+	try {
+		// size the output with a counting pass instead of the worst case of every cube, so the memory
+		// is proportional to the surface rather than the volume
+		slab.vertexCapacity = countSignChangeEdges(field, slab.range, isoThreshold, brickSummary);
+		slab.vertex = (Vertex*)allocate(slab.vertexCapacity * sizeof(Vertex), slab.contextSet, MeshingContext::VERTEX);
+		if (settings.computeNormals) {
+			slab.normal = (Vector3D*)allocate(slab.vertexCapacity * sizeof(Vector3D), slab.contextSet, MeshingContext::NORMAL);
+		}
+		slab.triangleCapacity = countTriangles(slab.range, caseIndexRow);
+		slab.triangle = (Triangle*)allocate(slab.triangleCapacity * sizeof(Triangle), slab.contextSet, MeshingContext::TRIANGLE);
+		MARCHING_CUBES_STATS_ONLY(slab.stats.countSeconds += getStatsSeconds() - countBegin);
+		deckMemory = (ReusableCubeData*)allocate(deckByteCount, slab.contextSet, MeshingContext::DECK);
+		ReusableCubeDoubleDeck reusableCubeDoubleDeck = ReusableCubeDoubleDeck(slab.range.yBegin, slab.range.zBegin, deckCubeCountY, deckCubeCountZ, deckMemory);
+		RowClassifier classifyRow = getRowClassifier<SampleType>();
+		// x is the slowest axis of the field, so the double-deck rolls along x
+		for (int i = slab.range.xBegin; i < slab.range.xEnd; i++) {
+			marchPlane(i, classifyRow, caseIndexRow, reusableCubeDoubleDeck, slab);
+		}
+	}
+	catch (...) {
+		// the arrays of the slab are released by the caller
+		if (deckMemory != NULL) {
+			release(deckMemory, deckByteCount, slab.contextSet, MeshingContext::DECK);
+		}
+		release(caseIndexRow, caseIndexRowByteCount, slab.contextSet, MeshingContext::CASE_ROW);
+		throw;
+	}
+	release(deckMemory, deckByteCount, slab.contextSet, MeshingContext::DECK);
+	release(caseIndexRow, caseIndexRowByteCount, slab.contextSet, MeshingContext::CASE_ROW);
+	slab.vertex = (Vertex*)shrink(slab.vertex, slab.vertexCapacity * sizeof(Vertex), slab.vertexCount * sizeof(Vertex), slab.contextSet, MeshingContext::VERTEX);
+	if (slab.normal != NULL) {
+		slab.normal = (Vector3D*)shrink(slab.normal, slab.vertexCapacity * sizeof(Vector3D), slab.vertexCount * sizeof(Vector3D), slab.contextSet, MeshingContext::NORMAL);
+	}
+	slab.vertexCapacity = slab.vertexCount;
+	slab.triangle = (Triangle*)shrink(slab.triangle, slab.triangleCapacity * sizeof(Triangle), slab.triangleCount * sizeof(Triangle), slab.contextSet, MeshingContext::TRIANGLE);
+	slab.triangleCapacity = slab.triangleCount;
+	MARCHING_CUBES_STATS_ONLY(hardwareCounters.stop(slab.stats));
+}
+
+// the slab of every level at once. a row of samples is read once by the counting pass and once by the marching
+// pass, and classified against the iso threshold of every level while it is in the cache. the arrays of the
+// slabs are released by the caller on failure
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::marchLevelSlab(MarchedGeometry* level[], MarchingSlab* slab[], int levelCount)
+{
+	MarchedGeometry& first = *level[0];
+	CubeRange slabRange = slab[0]->range;
+	int64 caseIndexRowByteCount = first.cubeCountZ;
+	int deckCubeCountY = slabRange.yEnd - slabRange.yBegin;
+	int deckCubeCountZ = slabRange.zEnd - slabRange.zBegin;
+	int64 deckByteCount = 2 * (int64)deckCubeCountY * deckCubeCountZ * sizeof(ReusableCubeData);
+	std::vector<uint8*> caseIndexRow(levelCount, NULL);
+	std::vector<ReusableCubeData*> deckMemory(levelCount, NULL);
+	RowClassifier classifyRow = getRowClassifier<SampleType>();
+	try {
+		for (int l = 0; l < levelCount; l++) {
+			caseIndexRow[l] = (uint8*)level[l]->allocate(caseIndexRowByteCount, slab[l]->contextSet, MeshingContext::CASE_ROW);
+		}
+		// the counting pass of marchSlab for every level: the sign change edges of the lattice points of the
+		// slab, and the triangles of its cubes
+		std::vector<int64> edgeCount(levelCount, 0);
+		std::vector<int64> triangleCount(levelCount, 0);
+		for (int i = slabRange.xBegin; i <= slabRange.xEnd; i++) {
+			for (int j = slabRange.yBegin; j <= slabRange.yEnd; j++) {
+				const SampleType* latticeRow = first.field.getRow(i, j);
+				const SampleType* nextRowX = (i < slabRange.xEnd) ? first.field.getRow(i + 1, j) : NULL;
+				const SampleType* nextRowY = (j < slabRange.yEnd) ? first.field.getRow(i, j + 1) : NULL;
+				bool isCubeRow = (i < slabRange.xEnd && j < slabRange.yEnd);
+				const SampleType* row[4];
+				if (isCubeRow) {
+					first.getRows(i, j, row);
+				}
+				for (int l = 0; l < levelCount; l++) {
+					edgeCount[l] += countRowSignChangeEdges(latticeRow, nextRowX, nextRowY, slabRange.zBegin, slabRange.zEnd + 1, slabRange.zEnd, level[l]->isoThreshold);
+					if (isCubeRow && level[l]->classifyActiveRow(i, j, slabRange.zBegin, slabRange.zEnd, row, classifyRow, caseIndexRow[l])) {
+						for (int k = slabRange.zBegin; k < slabRange.zEnd; k++) {
+							triangleCount[l] += caseGeometry[caseIndexRow[l][k]].triangleCount;
+						}
+					}
+				}
+			}
+		}
+		std::vector<ReusableCubeDoubleDeck> deck;
+		deck.reserve(levelCount);
+		for (int l = 0; l < levelCount; l++) {
+			MarchingSlab& levelSlab = *slab[l];
+			levelSlab.vertexCapacity = edgeCount[l];
+			levelSlab.vertex = (Vertex*)level[l]->allocate(levelSlab.vertexCapacity * sizeof(Vertex), levelSlab.contextSet, MeshingContext::VERTEX);
+			if (level[l]->settings.computeNormals) {
+				levelSlab.normal = (Vector3D*)level[l]->allocate(levelSlab.vertexCapacity * sizeof(Vector3D), levelSlab.contextSet, MeshingContext::NORMAL);
+			}
+			levelSlab.triangleCapacity = triangleCount[l];
+			levelSlab.triangle = (Triangle*)level[l]->allocate(levelSlab.triangleCapacity * sizeof(Triangle), levelSlab.contextSet, MeshingContext::TRIANGLE);
+			deckMemory[l] = (ReusableCubeData*)level[l]->allocate(deckByteCount, levelSlab.contextSet, MeshingContext::DECK);
+			deck.push_back(ReusableCubeDoubleDeck(slabRange.yBegin, slabRange.zBegin, deckCubeCountY, deckCubeCountZ, deckMemory[l]));
+		}
+		for (int i = slabRange.xBegin; i < slabRange.xEnd; i++) {
+			for (int j = slabRange.yBegin; j < slabRange.yEnd; j++) {
+				const SampleType* row[4];
+				first.getRows(i, j, row);
+				for (int l = 0; l < levelCount; l++) {
+					if (!level[l]->classifyActiveRow(i, j, slabRange.zBegin, slabRange.zEnd, row, classifyRow, caseIndexRow[l])) {
+						continue;
+					}
+					for (int k = slabRange.zBegin; k < slabRange.zEnd; k++) {
+						if (caseIndexRow[l][k] != 0 && caseIndexRow[l][k] != 0xFF) {
+							level[l]->marchCube(i, j, k, caseIndexRow[l][k], row, deck[l], *slab[l]);
+						}
+					}
+				}
+			}
+		}
+	}
+	catch (...) {
+		for (int l = 0; l < levelCount; l++) {
+			if (deckMemory[l] != NULL) {
+				level[l]->release(deckMemory[l], deckByteCount, slab[l]->contextSet, MeshingContext::DECK);
+			}
+			if (caseIndexRow[l] != NULL) {
+				level[l]->release(caseIndexRow[l], caseIndexRowByteCount, slab[l]->contextSet, MeshingContext::CASE_ROW);
+			}
+		}
+		throw;
+	}
+	for (int l = 0; l < levelCount; l++) {
+		MarchingSlab& levelSlab = *slab[l];
+		level[l]->release(deckMemory[l], deckByteCount, levelSlab.contextSet, MeshingContext::DECK);
+		level[l]->release(caseIndexRow[l], caseIndexRowByteCount, levelSlab.contextSet, MeshingContext::CASE_ROW);
+		levelSlab.vertex = (Vertex*)level[l]->shrink(levelSlab.vertex, levelSlab.vertexCapacity * sizeof(Vertex), levelSlab.vertexCount * sizeof(Vertex), levelSlab.contextSet, MeshingContext::VERTEX);
+		if (levelSlab.normal != NULL) {
+			levelSlab.normal = (Vector3D*)level[l]->shrink(levelSlab.normal, levelSlab.vertexCapacity * sizeof(Vector3D), levelSlab.vertexCount * sizeof(Vector3D), levelSlab.contextSet, MeshingContext::NORMAL);
+		}
+		levelSlab.vertexCapacity = levelSlab.vertexCount;
+		levelSlab.triangle = (Triangle*)level[l]->shrink(levelSlab.triangle, levelSlab.triangleCapacity * sizeof(Triangle), levelSlab.triangleCount * sizeof(Triangle), levelSlab.contextSet, MeshingContext::TRIANGLE);
+		levelSlab.triangleCapacity = levelSlab.triangleCount;
+	}
+}
+
+template<typename IndexType, typename SampleType>
+std::vector<MarchedGeometry<IndexType, SampleType>> MarchedGeometry<IndexType, SampleType>::marchLevels(Vector3D cubeScale, VolumetricView<SampleType> field, const std::vector<float>& isoValues, MarchingSettings settings)
+{
+	std::vector<MarchedGeometry> levels;
+	levels.reserve(isoValues.size());
+	// the levels with a surface to march, the others stay empty
+	std::vector<MarchedGeometry*> active;
+	CubeRange range(0, std::max(field.getSizeX() - 1, 0), 0, std::max(field.getSizeY() - 1, 0), 0, std::max(field.getSizeZ() - 1, 0));
+	for (size_t l = 0; l < isoValues.size(); l++) {
+		MarchingSettings levelSettings = settings;
+		levelSettings.isoValue = isoValues[l];
+		levelSettings.skipEmptyBricks = false;
+		levels.push_back(MarchedGeometry());
+		levels[l].initialize(cubeScale, field.getSizeX(), field.getSizeY(), field.getSizeZ(), range, levelSettings);
+		CubeRange& levelRange = levels[l].range;
+		if (levelRange.xBegin < levelRange.xEnd && levelRange.yBegin < levelRange.yEnd && levelRange.zBegin < levelRange.zEnd) {
+			levels[l].field = field;
+			active.push_back(&levels[l]);
+		}
+	}
+	if (active.empty()) {
+		return levels;
+	}
+	int levelCount = (int)active.size();
+	int slabCount = active[0]->getSlabCount();
+	// the slabs of a level are contiguous, as stitchSlabs takes them
+	std::vector<MarchingSlab> slabs((size_t)levelCount * slabCount);
+	for (int l = 0; l < levelCount; l++) {
+		for (int i = 0; i < slabCount; i++) {
+			MarchingSlab& slab = slabs[(size_t)l * slabCount + i];
+			slab.contextSet = (slabCount == 1) ? 0 : i + 1;
+			slab.range = range;
+			slab.range.xBegin = range.xBegin + (int)((int64)(range.xEnd - range.xBegin) * i / slabCount);
+			slab.range.xEnd = range.xBegin + (int)((int64)(range.xEnd - range.xBegin) * (i + 1) / slabCount);
+		}
+	}
+	auto marchSlabOfEveryLevel = [&active, &slabs, levelCount, slabCount](int slabIndex) {
+		std::vector<MarchingSlab*> slab(levelCount);
+		for (int l = 0; l < levelCount; l++) {
+			slab[l] = &slabs[(size_t)l * slabCount + slabIndex];
+		}
+		marchLevelSlab(active.data(), slab.data(), levelCount);
+	};
+	try {
+		if (slabCount == 1) {
+			marchSlabOfEveryLevel(0);
+		}
+		else {
+			std::vector<std::thread> workers;
+			std::vector<std::exception_ptr> errors(slabCount);
+			for (int i = 0; i < slabCount; i++) {
+				workers.push_back(std::thread([&marchSlabOfEveryLevel, &errors, i]() {
+					try {
+						marchSlabOfEveryLevel(i);
+					}
+					catch (...) {
+						errors[i] = std::current_exception();
+					}
+				}));
+			}
+			for (int i = 0; i < slabCount; i++) {
+				workers[i].join();
+			}
+			for (int i = 0; i < slabCount; i++) {
+				if (errors[i]) {
+					std::rethrow_exception(errors[i]);
+				}
+			}
+		}
+		for (int l = 0; l < levelCount; l++) {
+			for (int i = 0; i < slabCount; i++) {
+				active[l]->stats.add(slabs[(size_t)l * slabCount + i].stats);
+			}
+			active[l]->stitchSlabs(&slabs[(size_t)l * slabCount], slabCount);
+		}
+	}
+	catch (...) {
+		for (int l = 0; l < levelCount; l++) {
+			for (int i = 0; i < slabCount; i++) {
+				active[l]->releaseSlab(slabs[(size_t)l * slabCount + i]);
+			}
+		}
+		throw;
+	}
+	for (int l = 0; l < levelCount; l++) {
+		active[l]->field = VolumetricView<SampleType>();
+		if (active[l]->settings.compactVertices) {
+			active[l]->compactVertices();
+		}
+	}
+	return levels;
+}
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::releaseSlab(MarchingSlab& slab)
+{
+	release(slab.vertex, slab.vertexCapacity * sizeof(Vertex), slab.contextSet, MeshingContext::VERTEX);
+	if (slab.normal != NULL) {
+		release(slab.normal, slab.vertexCapacity * sizeof(Vector3D), slab.contextSet, MeshingContext::NORMAL);
+	}
+	release(slab.triangle, slab.triangleCapacity * sizeof(Triangle), slab.contextSet, MeshingContext::TRIANGLE);
+	slab.vertex = NULL;
+	slab.normal = NULL;
+	slab.triangle = NULL;
+	slab.vertexCapacity = 0;
+	slab.triangleCapacity = 0;
+}
+
+template<typename IndexType, typename SampleType>
+int64 MarchedGeometry<IndexType, SampleType>::marchStream(Vector3D cubeScale, VolumeSliceSource<SampleType>& source, MeshSink<IndexType>& sink, MarchingSettings settings, MarchingStats* stats)
+{
+	MarchedGeometry<IndexType, SampleType> geometry(cubeScale, source, settings);
+	geometry.marchSlices(source, sink);
+	if (stats != NULL) {
+		*stats = geometry.getStats();
+	}
+	return geometry.getPeakByteCount();
+}
+
+// the whole volume is marched as one slab, but field only holds slices x and x + 1 (and x - 1 and x + 2
+// for the normals) while plane x is marched, and the output of each plane is handed to the sink right after it
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::marchSlices(VolumeSliceSource<SampleType>& source, MeshSink<IndexType>& sink)
+{
+	if (cubeCountX <= 0 || cubeCountY <= 0 || cubeCountZ <= 0 || range.xBegin >= range.xEnd) {
+		return;
+	}
+	int64 sliceByteCount = (int64)(cubeCountY + 1) * (cubeCountZ + 1) * sizeof(SampleType);
+	int windowSliceCount = settings.computeNormals ? 4 : 2;
+	int leadSliceCount = settings.computeNormals ? 1 : 0;
+	VolumetricData<SampleType> window(windowSliceCount, cubeCountY + 1, cubeCountZ + 1);
+	field = window;
+	trackMemory((int64)windowSliceCount * sliceByteCount);
+	MarchingSlab slab;
+	slab.range = range;
+	int64 deckByteCount = 2 * (int64)cubeCountY * cubeCountZ * sizeof(ReusableCubeData);
+	trackMemory(deckByteCount);
+	MARCHING_CUBES_STATS_ONLY(HardwareCounters hardwareCounters);
+	try {
+		std::vector<ReusableCubeData> deckMemory(2 * (size_t)cubeCountY * cubeCountZ);
+		ReusableCubeDoubleDeck reusableCubeDoubleDeck = ReusableCubeDoubleDeck(0, 0, cubeCountY, cubeCountZ, deckMemory.data());
+		RowClassifier classifyRow = getRowClassifier<SampleType>();
+		std::vector<uint8> caseIndexRow(cubeCountZ);
+		MARCHING_CUBES_STATS_ONLY(double loadBegin = getStatsSeconds());
+		// slice j of field is slice i - leadSliceCount + j of the volume while plane i is marched
+		for (int j = leadSliceCount; j < windowSliceCount && j - leadSliceCount <= cubeCountX; j++) {
+			source.readSlice(j - leadSliceCount, window.getWritableSlice(j));
+		}
+		MARCHING_CUBES_STATS_ONLY(slab.stats.loadSeconds += getStatsSeconds() - loadBegin);
+		for (int i = 0; i < cubeCountX; i++) {
+			MARCHING_CUBES_STATS_ONLY(loadBegin = getStatsSeconds());
+			if (i > 0) {
+				memmove(window.getWritableSlice(0), window.getSlice(1), (size_t)(windowSliceCount - 1) * sliceByteCount);
+				int lastX = i - leadSliceCount + windowSliceCount - 1;
+				if (lastX <= cubeCountX) {
+					source.readSlice(lastX, window.getWritableSlice(windowSliceCount - 1));
+				}
+			}
+			MARCHING_CUBES_STATS_ONLY(double countBegin = getStatsSeconds());
+			MARCHING_CUBES_STATS_ONLY(slab.stats.loadSeconds += countBegin - loadBegin);
+			fieldOffsetX = i - leadSliceCount;
+			// the output of a plane is bounded the same way as the output of a slab
+			int64 vertexBound = countSignChangeEdges(field, CubeRange(leadSliceCount, leadSliceCount + 1, 0, cubeCountY, 0, cubeCountZ), isoThreshold);
+			int64 triangleBound = countTriangles(CubeRange(i, i + 1, 0, cubeCountY, 0, cubeCountZ), caseIndexRow.data());
+			MARCHING_CUBES_STATS_ONLY(slab.stats.countSeconds += getStatsSeconds() - countBegin);
+			if (slab.vertexCapacity < vertexBound || slab.triangleCapacity < triangleBound) {
+				// everything in the arrays was already handed to the sink, so they are replaced instead of grown
+				vertexBound = std::max(vertexBound, slab.vertexCapacity);
+				triangleBound = std::max(triangleBound, slab.triangleCapacity);
+				releaseSlab(slab);
+				slab.vertex = (Vertex*)allocate(vertexBound * sizeof(Vertex), slab.contextSet, MeshingContext::VERTEX);
+				slab.vertexCapacity = vertexBound;
+				if (settings.computeNormals) {
+					slab.normal = (Vector3D*)allocate(vertexBound * sizeof(Vector3D), slab.contextSet, MeshingContext::NORMAL);
+				}
+				slab.triangle = (Triangle*)allocate(triangleBound * sizeof(Triangle), slab.contextSet, MeshingContext::TRIANGLE);
+				slab.triangleCapacity = triangleBound;
+			}
+			marchPlane(i, classifyRow, caseIndexRow.data(), reusableCubeDoubleDeck, slab);
+			MARCHING_CUBES_STATS_ONLY(double writeBegin = getStatsSeconds());
+			if (slab.vertexCount > slab.vertexOffset) {
+				sink.addVertices(slab.vertex, slab.vertexCount - slab.vertexOffset);
+				if (slab.normal != NULL) {
+					sink.addNormals(slab.normal, slab.vertexCount - slab.vertexOffset);
+				}
+			}
+			if (slab.triangleCount > 0) {
+				sink.addTriangles(slab.triangle, slab.triangleCount);
+			}
+			MARCHING_CUBES_STATS_ONLY(slab.stats.writeSeconds += getStatsSeconds() - writeBegin);
+			// vertex indices keep counting up across planes, triangles restart at the beginning of their array
+			slab.vertexOffset = slab.vertexCount;
+			slab.triangleCount = 0;
+		}
+	}
+	catch (...) {
+		releaseSlab(slab);
+		trackMemory(-deckByteCount);
+		field = VolumetricView<SampleType>();
+		throw;
+	}
+	MARCHING_CUBES_STATS_ONLY(hardwareCounters.stop(slab.stats));
+	stats.add(slab.stats);
+	releaseSlab(slab);
+	trackMemory(-deckByteCount);
+	field = VolumetricView<SampleType>();
+}
+
+template<typename IndexType, typename SampleType>
+int MarchedGeometry<IndexType, SampleType>::getSlabCount()
+{
+	int slabCount = settings.threadCount;
+	if (slabCount <= 0) {
+		slabCount = std::thread::hardware_concurrency();
+	}
+	if (slabCount > range.xEnd - range.xBegin) {
+		slabCount = range.xEnd - range.xBegin;
+	}
+	return (slabCount < 1) ? 1 : slabCount;
+}
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::marchCubes()
+{
+	if (range.xBegin >= range.xEnd || range.yBegin >= range.yEnd || range.zBegin >= range.zEnd) {
+		return;
+	}
+	int slabCount = getSlabCount();
+	// a single slab, the usual case for small volumes, is kept on the stack
+	MarchingSlab singleSlab;
+	MarchingSlab* slabs = (slabCount == 1) ? &singleSlab : new MarchingSlab[slabCount];
+	for (int i = 0; i < slabCount; i++) {
+		// a single slab marches right into the arrays of the mesh
+		slabs[i].contextSet = (slabCount == 1) ? 0 : i + 1;
+		slabs[i].range = range;
+		slabs[i].range.xBegin = range.xBegin + (int)((int64)(range.xEnd - range.xBegin) * i / slabCount);
+		slabs[i].range.xEnd = range.xBegin + (int)((int64)(range.xEnd - range.xBegin) * (i + 1) / slabCount);
+	}
+	try {
+		if (slabCount == 1) {
+			marchSlab(slabs[0]);
+		}
+		else {
+			std::vector<std::thread> workers;
+			std::vector<std::exception_ptr> errors(slabCount);
+			for (int i = 0; i < slabCount; i++) {
+				workers.push_back(std::thread([this, slabs, &errors, i]() {
+					try {
+						marchSlab(slabs[i]);
+					}
+					catch (...) {
+						errors[i] = std::current_exception();
+					}
+				}));
+			}
+			for (int i = 0; i < slabCount; i++) {
+				workers[i].join();
+			}
+			for (int i = 0; i < slabCount; i++) {
+				if (errors[i]) {
+					std::rethrow_exception(errors[i]);
+				}
+			}
+		}
+		for (int i = 0; i < slabCount; i++) {
+			stats.add(slabs[i].stats);
+		}
+		MARCHING_CUBES_STATS_ONLY(double stitchBegin = getStatsSeconds());
+		stitchSlabs(slabs, slabCount);
+		MARCHING_CUBES_STATS_ONLY(stats.emitSeconds += getStatsSeconds() - stitchBegin);
+	}
+	catch (...) {
+		for (int i = 0; i < slabCount; i++) {
+			releaseSlab(slabs[i]);
+		}
+		if (slabs != &singleSlab) {
+			delete[] slabs;
+		}
+		throw;
+	}
+	if (slabs != &singleSlab) {
+		delete[] slabs;
+	}
+}
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::stitchSlabs(MarchingSlab slabs[], int slabCount)
+{
+	if (slabCount == 1) {
+		vertexCount = slabs[0].vertexCount;
+		triangleCount = slabs[0].triangleCount;
+		vertex = slabs[0].vertex;
+		triangle = slabs[0].triangle;
+		normal = slabs[0].normal;
+		return;
+	}
+	// remap[i][v] is the final index of vertex v of slab i. vertices on the lower plane of a slab
+	// that already exist on the upper plane of the previous slab are dropped and point to that vertex
+	std::vector<std::vector<int>> remap(slabCount);
+	std::vector<int> firstVertex(slabCount);
+	std::unordered_map<int64, int> upperVertexIndex;
+	std::unordered_map<int64, int> lowerVertexIndex;
+	for (int i = 0; i < slabCount; i++) {
+		std::vector<BoundaryVertex>& lowerBoundary = slabs[i].lowerBoundary;
+		remap[i].assign(slabs[i].vertexCount, -1);
+		lowerVertexIndex.clear();
+		for (size_t j = 0; j < lowerBoundary.size(); j++) {
+			auto shared = upperVertexIndex.find(lowerBoundary[j].key);
+			if (shared != upperVertexIndex.end()) {
+				remap[i][lowerBoundary[j].vertexIndex] = shared->second;
+			}
+			else if (lowerVertexIndex.count(lowerBoundary[j].key) == 0) {
+				lowerVertexIndex[lowerBoundary[j].key] = lowerBoundary[j].vertexIndex;
+			}
+			else {
+				// the same lattice point was created twice inside this slab, reuse the first one
+				remap[i][lowerBoundary[j].vertexIndex] = -2;
+			}
+		}
+		firstVertex[i] = vertexCount;
+		for (int j = 0; j < slabs[i].vertexCount; j++) {
+			if (remap[i][j] == -1) {
+				remap[i][j] = vertexCount++;
+			}
+		}
+		for (size_t j = 0; j < lowerBoundary.size(); j++) {
+			if (remap[i][lowerBoundary[j].vertexIndex] == -2) {
+				remap[i][lowerBoundary[j].vertexIndex] = remap[i][lowerVertexIndex[lowerBoundary[j].key]];
+			}
+		}
+		upperVertexIndex.clear();
+		for (size_t j = 0; j < slabs[i].upperBoundary.size(); j++) {
+			BoundaryVertex& boundaryVertex = slabs[i].upperBoundary[j];
+			upperVertexIndex[boundaryVertex.key] = remap[i][boundaryVertex.vertexIndex];
+		}
+		triangleCount += slabs[i].triangleCount;
+	}
+	if (vertexCount > MAX_VERTEX_COUNT) {
+		throw std::runtime_error("Vertex count exceeds the range of the index type in MarchedGeometry, use a wider index type");
+	}
+	vertex = (Vertex*)allocate(vertexCount * sizeof(Vertex), 0, MeshingContext::VERTEX);
+	if (settings.computeNormals) {
+		normal = (Vector3D*)allocate(vertexCount * sizeof(Vector3D), 0, MeshingContext::NORMAL);
+	}
+	triangle = (Triangle*)allocate(triangleCount * sizeof(Triangle), 0, MeshingContext::TRIANGLE);
+	int64 triangleCapacity = triangleCount;
+	triangleCount = 0;
+	for (int i = 0; i < slabCount; i++) {
+		for (int j = 0; j < slabs[i].vertexCount; j++) {
+			if (remap[i][j] >= firstVertex[i]) {
+				vertex[remap[i][j]] = slabs[i].vertex[j];
+				if (normal != NULL) {
+					normal[remap[i][j]] = slabs[i].normal[j];
+				}
+			}
+		}
+		for (int j = 0; j < slabs[i].triangleCount; j++) {
+			for (int k = 0; k < 3; k++) {
+				triangle[triangleCount].index[k] = remap[i][slabs[i].triangle[j].index[k]];
+			}
+			// merging duplicated vertices can collapse a triangle the serial path would have dropped
+			if (!isTriangleAreaZero(triangle[triangleCount])) {
+				triangleCount++;
+			}
+			else {
+				MARCHING_CUBES_STATS_ONLY(stats.degenerateTriangleCount++);
+			}
+		}
+		releaseSlab(slabs[i]);
+	}
+	triangle = (Triangle*)shrink(triangle, triangleCapacity * sizeof(Triangle), triangleCount * sizeof(Triangle), 0, MeshingContext::TRIANGLE);
+}
+
+template<typename IndexType, typename SampleType>
+bool MarchedGeometry<IndexType, SampleType>::canIndex(VolumetricView<SampleType> field, float isoValue)
+{
+	SampleType isoThreshold;
+	if (!getIsoThreshold(isoValue, isoThreshold)) {
+		return true;
+	}
+	return getVertexCountUpperBound(field, isoThreshold) <= MAX_VERTEX_COUNT;
+}
+
+template<typename IndexType, typename SampleType>
+int64 MarchedGeometry<IndexType, SampleType>::getByteCount()
+{
+	int64 normalByteCount = (normal != NULL) ? (int64)vertexCount * sizeof(Vector3D) : 0;
+	int64 vertexByteCount = (int64)vertexCount * ((compactVertex != NULL) ? sizeof(CompactVertex) : sizeof(Vertex));
+	return vertexByteCount + normalByteCount + (int64)triangleCount * sizeof(Triangle);
+}
+
+template<typename IndexType, typename SampleType>
+int MarchedGeometry<IndexType, SampleType>::getVertexCount()
+{
+	return vertexCount;
+}
+
+template<typename IndexType, typename SampleType>
+int MarchedGeometry<IndexType, SampleType>::getTriangleCount()
+{
+	return triangleCount;
+}
+
+template<typename IndexType, typename SampleType>
+const Vertex* MarchedGeometry<IndexType, SampleType>::getVertices()
+{
+	return vertex;
+}
+
+template<typename IndexType, typename SampleType>
+const CompactVertex* MarchedGeometry<IndexType, SampleType>::getCompactVertices()
+{
+	return compactVertex;
+}
+
+template<typename IndexType, typename SampleType>
+Vector3D MarchedGeometry<IndexType, SampleType>::getCompactVertexScale()
+{
+	return compactVertexScale;
+}
+
+template<typename IndexType, typename SampleType>
+Vector3D MarchedGeometry<IndexType, SampleType>::getCompactVertexOffset()
+{
+	return compactVertexOffset;
+}
+
+template<typename IndexType, typename SampleType>
+Vector3D MarchedGeometry<IndexType, SampleType>::getPosition(int vertexIndex)
+{
+	if (compactVertex == NULL) {
+		return vertex[vertexIndex].position;
+	}
+	Vector3D position;
+	position.x = compactVertexOffset.x + compactVertex[vertexIndex].position[0] * compactVertexScale.x;
+	position.y = compactVertexOffset.y + compactVertex[vertexIndex].position[1] * compactVertexScale.y;
+	position.z = compactVertexOffset.z + compactVertex[vertexIndex].position[2] * compactVertexScale.z;
+	return position;
+}
+
+// the compact vertices are written over the first half of the vertex array, vertex i only overwrites vertices
+// that were already read
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::compactVertices()
+{
+	if (compactVertex != NULL) {
+		return;
+	}
+	if (vertexCount == 0) {
+		// an empty mesh of several slabs can still have its stitched vertex array
+		release(vertex, 0, 0, MeshingContext::VERTEX);
+		vertex = NULL;
+		compactVertexScale.x = cubeScale.x / 256;
+		compactVertexScale.y = cubeScale.y / 256;
+		compactVertexScale.z = cubeScale.z / 256;
+		compactVertexOffset = Vector3D();
+		return;
+	}
+	if (vertex == NULL) {
+		return;
+	}
+	float scale[3] = { cubeScale.x, cubeScale.y, cubeScale.z };
+	float inverseScale[3], origin[3], quantum[3];
+	float minimum[3], maximum[3];
+	for (int axis = 0; axis < 3; axis++) {
+		inverseScale[axis] = (scale[axis] != 0) ? 1 / scale[axis] : 0;
+	}
+	for (int i = 0; i < vertexCount; i++) {
+		float lattice[3] = { vertex[i].position.x * inverseScale[0], vertex[i].position.y * inverseScale[1], vertex[i].position.z * inverseScale[2] };
+		for (int axis = 0; axis < 3; axis++) {
+			minimum[axis] = (i == 0) ? lattice[axis] : std::min(minimum[axis], lattice[axis]);
+			maximum[axis] = (i == 0) ? lattice[axis] : std::max(maximum[axis], lattice[axis]);
+		}
+	}
+	for (int axis = 0; axis < 3; axis++) {
+		origin[axis] = std::floor(minimum[axis]);
+		float extent = std::ceil(maximum[axis]) - origin[axis];
+		if (extent > 0xFFFF) {
+			throw std::runtime_error("Mesh too large for compact vertices in MarchedGeometry compactVertices function");
+		}
+		int fractionBits = 8;
+		while (fractionBits > 0 && extent * (1 << fractionBits) > 0xFFFF) {
+			fractionBits--;
+		}
+		quantum[axis] = (float)(1 << fractionBits);
+	}
+	compactVertexScale.x = scale[0] / quantum[0];
+	compactVertexScale.y = scale[1] / quantum[1];
+	compactVertexScale.z = scale[2] / quantum[2];
+	compactVertexOffset.x = origin[0] * scale[0];
+	compactVertexOffset.y = origin[1] * scale[1];
+	compactVertexOffset.z = origin[2] * scale[2];
+	uint8* memory = (uint8*)vertex;
+	for (int i = 0; i < vertexCount; i++) {
+		float position[3];
+		memcpy(position, memory + (size_t)i * sizeof(Vertex), sizeof(position));
+		CompactVertex compact;
+		for (int axis = 0; axis < 3; axis++) {
+			float fixedPoint = (position[axis] * inverseScale[axis] - origin[axis]) * quantum[axis];
+			compact.position[axis] = (uint16)std::max(0L, std::min(0xFFFFL, std::lround(fixedPoint)));
+		}
+		memcpy(memory + (size_t)i * sizeof(CompactVertex), &compact, sizeof(CompactVertex));
+	}
+	compactVertex = (CompactVertex*)shrink(vertex, (int64)vertexCount * sizeof(Vertex), (int64)vertexCount * sizeof(CompactVertex), 0, MeshingContext::VERTEX);
+	vertex = NULL;
+}
+
+template<typename IndexType, typename SampleType>
+const IndexedTriangle<IndexType>* MarchedGeometry<IndexType, SampleType>::getTriangles()
+{
+	return triangle;
+}
+
+template<typename IndexType, typename SampleType>
+const Vector3D* MarchedGeometry<IndexType, SampleType>::getNormals()
+{
+	return normal;
+}
+
+template<typename IndexType, typename SampleType>
+int64 MarchedGeometry<IndexType, SampleType>::getPeakByteCount()
+{
+	return peakByteCount;
+}
+
+template<typename IndexType, typename SampleType>
+const MarchingStats& MarchedGeometry<IndexType, SampleType>::getStats()
+{
+	return stats;
+}
+
+template<typename IndexType, typename SampleType>
+int MarchedGeometry<IndexType, SampleType>::getSkippedBrickCount()
+{
+	return (brickSummary != NULL) ? brickSummary->getUniformBrickCount() : 0;
+}
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::translate(Vector3D offset)
+{
+	if (compactVertex != NULL) {
+		compactVertexOffset.x += offset.x;
+		compactVertexOffset.y += offset.y;
+		compactVertexOffset.z += offset.z;
+		return;
+	}
+	for (int i = 0; i < vertexCount; i++) {
+		vertex[i].position.x += offset.x;
+		vertex[i].position.y += offset.y;
+		vertex[i].position.z += offset.z;
+	}
+}
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::toFile(const char filename[]) {
+	MARCHING_CUBES_STATS_ONLY(double writeBegin = getStatsSeconds());
+	BufferedWriter writer(filename);
+	writer.writeInt(vertexCount);
+	writer.writeText("\n");
+	for (int i = 0; i < vertexCount; i++) {
+		Vector3D position = getPosition(i);
+		writer.writeFloat(position.x);
+		writer.writeText(" ");
+		writer.writeFloat(position.y);
+		writer.writeText(" ");
+		writer.writeFloat(position.z);
+		writer.writeText("\n");
+	}
+	writer.writeInt(triangleCount);
+	writer.writeText("\n");
+	for (int i = 0; i < triangleCount; i++) {
+		writer.writeInt(triangle[i].index[0]);
+		writer.writeText(" ");
+		writer.writeInt(triangle[i].index[1]);
+		writer.writeText(" ");
+		writer.writeInt(triangle[i].index[2]);
+		writer.writeText("\n");
+	}
+	writer.close();
+	MARCHING_CUBES_STATS_ONLY(stats.writeSeconds += getStatsSeconds() - writeBegin);
+}
+
+static_assert(sizeof(Vertex) == 3 * sizeof(float), "Vertex is written to binary files as 3 floats");
+static_assert(sizeof(CompactVertex) == 3 * sizeof(uint16), "CompactVertex is written to binary files as 3 uint16");
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::toPlyFile(const char filename[]) {
+	MARCHING_CUBES_STATS_ONLY(double writeBegin = getStatsSeconds());
+	BufferedWriter writer(filename);
+	writer.writeText("ply\nformat binary_little_endian 1.0\n");
+	if (compactVertex != NULL) {
+		// the scale and offset of the compact positions, x y z
+		const Vector3D* transform[2] = { &compactVertexScale, &compactVertexOffset };
+		const char* transformName[2] = { "comment compact_vertex_scale", "comment compact_vertex_offset" };
+		for (int i = 0; i < 2; i++) {
+			writer.writeText(transformName[i]);
+			writer.writeText(" ");
+			writer.writeFloat(transform[i]->x);
+			writer.writeText(" ");
+			writer.writeFloat(transform[i]->y);
+			writer.writeText(" ");
+			writer.writeFloat(transform[i]->z);
+			writer.writeText("\n");
+		}
+	}
+	writer.writeText("element vertex ");
+	writer.writeInt(vertexCount);
+	writer.writeText((compactVertex != NULL) ? "\nproperty ushort x\nproperty ushort y\nproperty ushort z\n" : "\nproperty float x\nproperty float y\nproperty float z\n");
+	if (normal != NULL) {
+		writer.writeText("property float nx\nproperty float ny\nproperty float nz\n");
+	}
+	writer.writeText("element face ");
+	writer.writeInt(triangleCount);
+	writer.writeText((sizeof(IndexType) == 2) ? "\nproperty list uchar ushort vertex_indices\n" : "\nproperty list uchar uint vertex_indices\n");
+	writer.writeText("end_header\n");
+	const uint8* vertexData = (compactVertex != NULL) ? (const uint8*)compactVertex : (const uint8*)vertex;
+	size_t vertexSize = (compactVertex != NULL) ? sizeof(CompactVertex) : sizeof(Vertex);
+	if (normal != NULL) {
+		for (int i = 0; i < vertexCount; i++) {
+			writer.write(vertexData + i * vertexSize, vertexSize);
+			writer.write(&normal[i], sizeof(Vector3D));
+		}
+	}
+	else {
+		writer.write(vertexData, (size_t)vertexCount * vertexSize);
+	}
+	for (int i = 0; i < triangleCount; i++) {
+		uint8 indexCount = 3;
+		writer.write(&indexCount, sizeof(uint8));
+		writer.write(triangle[i].index, 3 * sizeof(IndexType));
+	}
+	writer.close();
+	MARCHING_CUBES_STATS_ONLY(stats.writeSeconds += getStatsSeconds() - writeBegin);
+}
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::toObjFile(const char filename[]) {
+	MARCHING_CUBES_STATS_ONLY(double writeBegin = getStatsSeconds());
+	BufferedWriter writer(filename);
+	for (int i = 0; i < vertexCount; i++) {
+		Vector3D position = getPosition(i);
+		writer.writeText("v ");
+		writer.writeFloat(position.x);
+		writer.writeText(" ");
+		writer.writeFloat(position.y);
+		writer.writeText(" ");
+		writer.writeFloat(position.z);
+		writer.writeText("\n");
+	}
+	for (int i = 0; normal != NULL && i < vertexCount; i++) {
+		writer.writeText("vn ");
+		writer.writeFloat(normal[i].x);
+		writer.writeText(" ");
+		writer.writeFloat(normal[i].y);
+		writer.writeText(" ");
+		writer.writeFloat(normal[i].z);
+		writer.writeText("\n");
+	}
+	// obj indices start from 1, and each vertex uses the normal with the same index
+	for (int i = 0; i < triangleCount; i++) {
+		writer.writeText("f");
+		for (int j = 0; j < 3; j++) {
+			writer.writeText(" ");
+			writer.writeInt((int64)triangle[i].index[j] + 1);
+			if (normal != NULL) {
+				writer.writeText("//");
+				writer.writeInt((int64)triangle[i].index[j] + 1);
+			}
+		}
+		writer.writeText("\n");
+	}
+	writer.close();
+	MARCHING_CUBES_STATS_ONLY(stats.writeSeconds += getStatsSeconds() - writeBegin);
+}
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::toRawFiles(const char vertexFilename[], const char indexFilename[], const char normalFilename[]) {
+	MARCHING_CUBES_STATS_ONLY(double writeBegin = getStatsSeconds());
+	BufferedWriter vertexWriter(vertexFilename);
+	if (compactVertex != NULL) {
+		vertexWriter.write(compactVertex, (size_t)vertexCount * sizeof(CompactVertex));
+	}
+	else {
+		vertexWriter.write(vertex, (size_t)vertexCount * sizeof(Vertex));
+	}
+	vertexWriter.close();
+	BufferedWriter indexWriter(indexFilename);
+	indexWriter.write(triangle, (size_t)triangleCount * sizeof(Triangle));
+	indexWriter.close();
+	if (normalFilename != NULL && normal != NULL) {
+		BufferedWriter normalWriter(normalFilename);
+		normalWriter.write(normal, (size_t)vertexCount * sizeof(Vector3D));
+		normalWriter.close();
+	}
+	MARCHING_CUBES_STATS_ONLY(stats.writeSeconds += getStatsSeconds() - writeBegin);
+}
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::optimizeVertexCache(int cacheSize)
+{
+	if (cacheSize < 3) {
+		throw std::runtime_error("Vertex cache must hold at least a triangle in MarchedGeometry optimizeVertexCache function");
+	}
+	if (triangleCount == 0) {
+		return;
+	}
+	// the triangles of each vertex, vertexTriangle[firstTriangle[v], firstTriangle[v + 1])
+	std::vector<int> firstTriangle(vertexCount + 1, 0);
+	for (int t = 0; t < triangleCount; t++) {
+		for (int i = 0; i < 3; i++) {
+			firstTriangle[triangle[t].index[i] + 1]++;
+		}
+	}
+	for (int v = 0; v < vertexCount; v++) {
+		firstTriangle[v + 1] += firstTriangle[v];
+	}
+	std::vector<int> vertexTriangle(firstTriangle[vertexCount]);
+	// the triangles of each vertex not emitted yet
+	std::vector<int> liveTriangleCount(vertexCount);
+	for (int v = 0; v < vertexCount; v++) {
+		liveTriangleCount[v] = firstTriangle[v + 1] - firstTriangle[v];
+	}
+	std::vector<int> nextSlot(firstTriangle.begin(), firstTriangle.end() - 1);
+	for (int t = 0; t < triangleCount; t++) {
+		for (int i = 0; i < 3; i++) {
+			vertexTriangle[nextSlot[triangle[t].index[i]]++] = t;
+		}
+	}
+	// a vertex is in the cache while fewer than cacheSize vertices entered it after, time counts the entries
+	std::vector<int> cacheTime(vertexCount, 0);
+	int time = cacheSize + 1;
+	std::vector<uint8> isEmitted(triangleCount, 0);
+	std::vector<Triangle> emitted;
+	emitted.reserve(triangleCount);
+	// the vertices of the emitted triangles, the most recent first, to restart from once the fan is stuck
+	std::vector<int> deadEnd;
+	std::vector<int> candidate;
+	int nextUnvisited = 0;
+	int fanVertex = -1;
+	while (true) {
+		if (fanVertex < 0) {
+			while (!deadEnd.empty() && fanVertex < 0) {
+				int v = deadEnd.back();
+				deadEnd.pop_back();
+				fanVertex = (liveTriangleCount[v] > 0) ? v : -1;
+			}
+			while (fanVertex < 0 && nextUnvisited < vertexCount) {
+				fanVertex = (liveTriangleCount[nextUnvisited] > 0) ? nextUnvisited : -1;
+				nextUnvisited++;
+			}
+			if (fanVertex < 0) {
+				break;
+			}
+		}
+		// emits the whole fan of the vertex
+		candidate.clear();
+		for (int slot = firstTriangle[fanVertex]; slot < firstTriangle[fanVertex + 1]; slot++) {
+			int t = vertexTriangle[slot];
+			if (isEmitted[t]) {
+				continue;
+			}
+			isEmitted[t] = 1;
+			emitted.push_back(triangle[t]);
+			for (int i = 0; i < 3; i++) {
+				int v = triangle[t].index[i];
+				deadEnd.push_back(v);
+				candidate.push_back(v);
+				liveTriangleCount[v]--;
+				if (time - cacheTime[v] > cacheSize) {
+					cacheTime[v] = time++;
+				}
+			}
+		}
+		// continues from the vertex of the fan that stays longest in the cache while its triangles are emitted
+		fanVertex = -1;
+		int bestPriority = -1;
+		for (size_t i = 0; i < candidate.size(); i++) {
+			int v = candidate[i];
+			if (liveTriangleCount[v] == 0) {
+				continue;
+			}
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangleCount[v] <= cacheSize) {
+				priority = time - cacheTime[v];
+			}
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				fanVertex = v;
+			}
+		}
+	}
+	memcpy(triangle, emitted.data(), (size_t)triangleCount * sizeof(Triangle));
+}
+
+template<typename IndexType, typename SampleType>
+void MarchedGeometry<IndexType, SampleType>::reorderVertices()
+{
+	const int UNUSED = -1;
+	std::vector<int> newIndex(vertexCount, UNUSED);
+	int nextIndex = 0;
+	for (int t = 0; t < triangleCount; t++) {
+		for (int i = 0; i < 3; i++) {
+			int v = triangle[t].index[i];
+			if (newIndex[v] == UNUSED) {
+				newIndex[v] = nextIndex++;
+			}
+			triangle[t].index[i] = (IndexType)newIndex[v];
+		}
+	}
+	for (int v = 0; v < vertexCount; v++) {
+		if (newIndex[v] == UNUSED) {
+			newIndex[v] = nextIndex++;
+		}
+	}
+	if (compactVertex != NULL) {
+		std::vector<CompactVertex> oldVertex(compactVertex, compactVertex + vertexCount);
+		for (int v = 0; v < vertexCount; v++) {
+			compactVertex[newIndex[v]] = oldVertex[v];
+		}
+	}
+	else {
+		std::vector<Vertex> oldVertex(vertex, vertex + vertexCount);
+		for (int v = 0; v < vertexCount; v++) {
+			vertex[newIndex[v]] = oldVertex[v];
+		}
+	}
+	if (normal != NULL) {
+		std::vector<Vector3D> oldNormal(normal, normal + vertexCount);
+		for (int v = 0; v < vertexCount; v++) {
+			normal[newIndex[v]] = oldNormal[v];
+		}
+	}
+}
+
+template<typename IndexType, typename SampleType>
+MeshletSet MarchedGeometry<IndexType, SampleType>::buildMeshlets(int maxVertexCount, int maxTriangleCount)
+{
+	if (maxVertexCount < 3 || maxVertexCount > 256 || maxTriangleCount < 1) {
+		throw std::runtime_error("Meshlets must hold 3 to 256 vertices and a triangle in MarchedGeometry buildMeshlets function");
+	}
+	MeshletSet meshlets;
+	// index of each vertex among the vertices of the current meshlet
+	std::vector<int> localIndex(vertexCount, -1);
+	Meshlet current = Meshlet();
+	for (int t = 0; t <= triangleCount; t++) {
+		int newVertexCount = 0;
+		if (t < triangleCount) {
+			for (int i = 0; i < 3; i++) {
+				newVertexCount += (localIndex[triangle[t].index[i]] < 0);
+			}
+		}
+		bool isFull = current.vertexCount + newVertexCount > maxVertexCount || current.triangleCount == maxTriangleCount;
+		if ((t == triangleCount || isFull) && current.triangleCount > 0) {
+			float minimum[3], maximum[3];
+			for (int i = 0; i < current.vertexCount; i++) {
+				Vector3D position = getPosition(meshlets.vertex[current.vertexOffset + i]);
+				float coordinate[3] = { position.x, position.y, position.z };
+				for (int axis = 0; axis < 3; axis++) {
+					minimum[axis] = (i == 0) ? coordinate[axis] : std::min(minimum[axis], coordinate[axis]);
+					maximum[axis] = (i == 0) ? coordinate[axis] : std::max(maximum[axis], coordinate[axis]);
+				}
+				localIndex[meshlets.vertex[current.vertexOffset + i]] = -1;
+			}
+			current.center.x = (minimum[0] + maximum[0]) * 0.5f;
+			current.center.y = (minimum[1] + maximum[1]) * 0.5f;
+			current.center.z = (minimum[2] + maximum[2]) * 0.5f;
+			current.radius = 0;
+			// the unit normals of the triangles, facing outside the surface like the vertex normals
+			std::vector<Vector3D> faceNormal(current.triangleCount);
+			float axis[3] = { 0, 0, 0 };
+			for (int i = 0; i < current.vertexCount; i++) {
+				Vector3D position = getPosition(meshlets.vertex[current.vertexOffset + i]);
+				float dx = position.x - current.center.x, dy = position.y - current.center.y, dz = position.z - current.center.z;
+				current.radius = std::max(current.radius, std::sqrt(dx * dx + dy * dy + dz * dz));
+			}
+			for (int i = 0; i < current.triangleCount; i++) {
+				const uint8* local = &meshlets.triangle[3 * (current.triangleOffset + i)];
+				Vector3D p0 = getPosition(meshlets.vertex[current.vertexOffset + local[0]]);
+				Vector3D p1 = getPosition(meshlets.vertex[current.vertexOffset + local[1]]);
+				Vector3D p2 = getPosition(meshlets.vertex[current.vertexOffset + local[2]]);
+				float ux = p1.x - p0.x, uy = p1.y - p0.y, uz = p1.z - p0.z;
+				float vx = p2.x - p0.x, vy = p2.y - p0.y, vz = p2.z - p0.z;
+				float nx = uy * vz - uz * vy, ny = uz * vx - ux * vz, nz = ux * vy - uy * vx;
+				float length = std::sqrt(nx * nx + ny * ny + nz * nz);
+				float scale = (length > 0) ? 1 / length : 0;
+				faceNormal[i].x = nx * scale;
+				faceNormal[i].y = ny * scale;
+				faceNormal[i].z = nz * scale;
+				axis[0] += faceNormal[i].x;
+				axis[1] += faceNormal[i].y;
+				axis[2] += faceNormal[i].z;
+			}
+			float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+			float axisScale = (axisLength > 0) ? 1 / axisLength : 0;
+			current.coneAxis.x = axis[0] * axisScale;
+			current.coneAxis.y = axis[1] * axisScale;
+			current.coneAxis.z = axis[2] * axisScale;
+			// the cone reaches the normal furthest from its axis, the meshlet is culled when the view direction is
+			// within 90 degrees of every normal, so the cutoff is the sine of the cone's half angle
+			float minimumDot = (axisLength > 0) ? 1.0f : -1.0f;
+			for (int i = 0; i < current.triangleCount; i++) {
+				minimumDot = std::min(minimumDot, faceNormal[i].x * current.coneAxis.x + faceNormal[i].y * current.coneAxis.y + faceNormal[i].z * current.coneAxis.z);
+			}
+			current.coneCutoff = (minimumDot > 0) ? std::sqrt(1 - minimumDot * minimumDot) : 1.0f;
+			meshlets.meshlet.push_back(current);
+			current = Meshlet();
+			current.vertexOffset = (int)meshlets.vertex.size();
+			current.triangleOffset = (int)(meshlets.triangle.size() / 3);
+		}
+		if (t == triangleCount) {
+			break;
+		}
+		for (int i = 0; i < 3; i++) {
+			int v = triangle[t].index[i];
+			if (localIndex[v] < 0) {
+				localIndex[v] = current.vertexCount++;
+				meshlets.vertex.push_back((uint32)v);
+			}
+			meshlets.triangle.push_back((uint8)localIndex[v]);
+		}
+		current.triangleCount++;
+	}
+	return meshlets;
+}
+
+template<typename SampleType>
+bool MarchingCubesTables::classifyRowScalar(const SampleType* row[4], int cubeCount, SampleType isoThreshold, uint8 caseIndex[])
+{
+	bool isAnyCubeActive = false;
+	for (int k = 0; k < cubeCount; k++) {
+		uint32 value = 0;
+		for (int i = 0; i < CORNER_COUNT; i++) {
+			uint32 isInside = (row[i & 3][k + (i >> 2)] < isoThreshold) ? 1 : 0;
+			value |= isInside << i;
+		}
+		caseIndex[k] = value;
+		isAnyCubeActive |= (value != 0 && value != 0xFF);
+	}
+	return isAnyCubeActive;
 }
 
-MarchedGeometry::MarchedGeometry(Vector3D cubeScale, VolumetricData<int8>_field) : field(_field)
+#ifdef MARCHING_CUBES_SSE2
+// 0xFF in each byte whose sample, among the 16 from sample on, is below isoThreshold
+template<typename SampleType>
+static inline __m128i getInsideMaskSSE2(const SampleType* sample, SampleType isoThreshold)
 {
-	this->cubeScale = cubeScale;
-	cubeCountX = field.getSizeX() - 1;
-	cubeCountY = field.getSizeY() - 1;
-	cubeCountZ = field.getSizeZ() - 1;
-	this->size = Vector3D(cubeScale.x * cubeCountX, cubeScale.y * cubeCountY, cubeScale.z * cubeCountZ);
-	vertexCount = 0;
-	triangleCount = 0;
-	int cubeCount = cubeCountX * cubeCountY * cubeCountZ;
-	int maxVertexCount = cubeCount * MAX_VERTEX_PER_CUBE;
-	int maxTriangleCount = cubeCount * MAX_TRIANGLE_PER_CUBE;
-	vertex = (Vertex*)malloc(maxVertexCount * sizeof(Vertex));
-	triangle = (Triangle*)malloc(maxTriangleCount * sizeof(Triangle));
-	marchCubes();
+	if constexpr (std::is_same<SampleType, int8>::value) {
+		return _mm_cmplt_epi8(_mm_loadu_si128((const __m128i*)sample), _mm_set1_epi8(isoThreshold));
+	}
+	else if constexpr (std::is_same<SampleType, uint8>::value) {
+		// unsigned bytes compare as signed ones once their top bit is flipped
+		const __m128i bias = _mm_set1_epi8((char)0x80);
+		return _mm_cmplt_epi8(_mm_xor_si128(_mm_loadu_si128((const __m128i*)sample), bias), _mm_set1_epi8((char)(isoThreshold ^ 0x80)));
+	}
+	else if constexpr (std::is_same<SampleType, int16>::value) {
+		const __m128i threshold = _mm_set1_epi16(isoThreshold);
+		__m128i low = _mm_cmplt_epi16(_mm_loadu_si128((const __m128i*)sample), threshold);
+		__m128i high = _mm_cmplt_epi16(_mm_loadu_si128((const __m128i*)(sample + 8)), threshold);
+		return _mm_packs_epi16(low, high);
+	}
+	else {
+		static_assert(std::is_same<SampleType, float>::value, "Unsupported sample type");
+		const __m128 threshold = _mm_set1_ps(isoThreshold);
+		__m128i mask[4];
+		for (int i = 0; i < 4; i++) {
+			mask[i] = _mm_castps_si128(_mm_cmplt_ps(_mm_loadu_ps(sample + 4 * i), threshold));
+		}
+		return _mm_packs_epi16(_mm_packs_epi32(mask[0], mask[1]), _mm_packs_epi32(mask[2], mask[3]));
+	}
 }
 
-MarchedGeometry::~MarchedGeometry()
+// 16 cubes at a time. a corner contributes its bit to the case index of a cube where its value is below
+// isoThreshold
+template<typename SampleType>
+bool MarchingCubesTables::classifyRowSSE2(const SampleType* row[4], int cubeCount, SampleType isoThreshold, uint8 caseIndex[])
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i full = _mm_set1_epi8((char)0xFF);
+	int emptyMask = 0xFFFF;
+	int k = 0;
+	for (; k + 16 <= cubeCount; k += 16) {
+		__m128i value = zero;
+		for (int i = 0; i < CORNER_COUNT; i++) {
+			__m128i isInside = getInsideMaskSSE2(row[i & 3] + k + (i >> 2), isoThreshold);
+			value = _mm_or_si128(value, _mm_and_si128(isInside, _mm_set1_epi8((char)(1 << i))));
+		}
+		_mm_storeu_si128((__m128i*)(caseIndex + k), value);
+		emptyMask &= _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(value, zero), _mm_cmpeq_epi8(value, full)));
+	}
+	const SampleType* tailRow[4] = { row[0] + k, row[1] + k, row[2] + k, row[3] + k };
+	bool isTailActive = classifyRowScalar(tailRow, cubeCount - k, isoThreshold, caseIndex + k);
+	return isTailActive || emptyMask != 0xFFFF;
+}
+#else
+template<typename SampleType>
+bool MarchingCubesTables::classifyRowSSE2(const SampleType* row[4], int cubeCount, SampleType isoThreshold, uint8 caseIndex[])
 {
-	free(vertex);
-	free(triangle);
+	return classifyRowScalar(row, cubeCount, isoThreshold, caseIndex);
 }
+#endif
 
-int8 MarchedGeometry::getCornerFieldValue(int x, int y, int z, int cornerIndex) {
-	return field.get(x + (cornerIndex & 1), y + ((cornerIndex & 2) >> 1), z + ((cornerIndex & 4) >> 2));
+#ifdef MARCHING_CUBES_AVX2
+// same as getInsideMaskSSE2 for 32 samples. the packs work within 128-bit lanes, so the wider samples are
+// permuted back in order
+template<typename SampleType>
+MARCHING_CUBES_TARGET_AVX2 static inline __m256i getInsideMaskAVX2(const SampleType* sample, SampleType isoThreshold)
+{
+	if constexpr (std::is_same<SampleType, int8>::value) {
+		return _mm256_cmpgt_epi8(_mm256_set1_epi8(isoThreshold), _mm256_loadu_si256((const __m256i*)sample));
+	}
+	else if constexpr (std::is_same<SampleType, uint8>::value) {
+		const __m256i bias = _mm256_set1_epi8((char)0x80);
+		return _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(isoThreshold ^ 0x80)), _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)sample), bias));
+	}
+	else if constexpr (std::is_same<SampleType, int16>::value) {
+		const __m256i threshold = _mm256_set1_epi16(isoThreshold);
+		__m256i low = _mm256_cmpgt_epi16(threshold, _mm256_loadu_si256((const __m256i*)sample));
+		__m256i high = _mm256_cmpgt_epi16(threshold, _mm256_loadu_si256((const __m256i*)(sample + 16)));
+		return _mm256_permute4x64_epi64(_mm256_packs_epi16(low, high), 0xD8);
+	}
+	else {
+		static_assert(std::is_same<SampleType, float>::value, "Unsupported sample type");
+		const __m256 threshold = _mm256_set1_ps(isoThreshold);
+		__m256i mask[4];
+		for (int i = 0; i < 4; i++) {
+			mask[i] = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(sample + 8 * i), threshold, _CMP_LT_OQ));
+		}
+		__m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(mask[0], mask[1]), _mm256_packs_epi32(mask[2], mask[3]));
+		return _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+	}
 }
 
-uint32 MarchedGeometry::getCaseIndex(int x, int y, int z)
+// same as the SSE2 version with 32 cubes at a time
+template<typename SampleType>
+MARCHING_CUBES_TARGET_AVX2 bool MarchingCubesTables::classifyRowAVX2(const SampleType* row[4], int cubeCount, SampleType isoThreshold, uint8 caseIndex[])
 {
-	uint32 value = 0;
-	for (int i = 0; i < CORNER_COUNT; i++) {
-		int8 vertexValue = getCornerFieldValue(x, y, z, i);
-		uint32 vertexSign = vertexValue & 0x80;
-		value |= vertexSign >> (7 - i);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i full = _mm256_set1_epi8((char)0xFF);
+	uint32 emptyMask = 0xFFFFFFFF;
+	int k = 0;
+	for (; k + 32 <= cubeCount; k += 32) {
+		__m256i value = zero;
+		for (int i = 0; i < CORNER_COUNT; i++) {
+			__m256i isInside = getInsideMaskAVX2(row[i & 3] + k + (i >> 2), isoThreshold);
+			value = _mm256_or_si256(value, _mm256_and_si256(isInside, _mm256_set1_epi8((char)(1 << i))));
+		}
+		_mm256_storeu_si256((__m256i*)(caseIndex + k), value);
+		emptyMask &= (uint32)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(value, zero), _mm256_cmpeq_epi8(value, full)));
 	}
-	return value;
+	const SampleType* tailRow[4] = { row[0] + k, row[1] + k, row[2] + k, row[3] + k };
+	bool isTailActive = classifyRowSSE2(tailRow, cubeCount - k, isoThreshold, caseIndex + k);
+	return isTailActive || emptyMask != 0xFFFFFFFF;
 }
 
-uint32 MarchedGeometry::getCornerDeltaMask(int x, int y, int z)
+static bool isAVX2Supported()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	bool isXSaveEnabled = (info[2] & (1 << 27)) != 0;
+	if (!isXSaveEnabled || (_xgetbv(0) & 6) != 6) {
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#else
+template<typename SampleType>
+bool MarchingCubesTables::classifyRowAVX2(const SampleType* row[4], int cubeCount, SampleType isoThreshold, uint8 caseIndex[])
 {
-	uint32 xMask = (x == 0) ? 0 : 1;
-	uint32 yMask = (y == 0) ? 0 : 2;
-	uint32 zMask = (z == 0) ? 0 : 4;
-	return (xMask | yMask | zMask);
+	return classifyRowSSE2(row, cubeCount, isoThreshold, caseIndex);
 }
 
-uint32 MarchedGeometry::getEdgeDeltaMask(int x, int y, int z)
+static bool isAVX2Supported()
 {
-	uint32 xMask = (x == 0) ? 0 : 1;
-	uint32 yMask = (y == 0) ? 0 : 6;
-	uint32 zMask = (z == 0) ? 0 : 8;
-	return (xMask | yMask | zMask);
+	return false;
 }
+#endif
 
-int32 MarchedGeometry::getInterpolationT(int x, int y, int z, OnEdgeVertexCode code)
+template<typename SampleType>
+MarchingCubesTables::RowClassifierOf<SampleType> MarchingCubesTables::getRowClassifier()
 {
-	int32 fieldValue0 = getCornerFieldValue(x, y, z, code.parts.lowerNumberedCorner);
-	int32 fieldValue1 = getCornerFieldValue(x, y, z, code.parts.higherNumberedCorner);
-	int32 interpolationT = (fieldValue1 << 8) / (fieldValue1 - fieldValue0);
-	return interpolationT;
+	static const RowClassifierOf<SampleType> classifier = isAVX2Supported() ? classifyRowAVX2<SampleType> : classifyRowSSE2<SampleType>;
+	return classifier;
 }
 
-void MarchedGeometry::ReusableCubeData::reset() {
-	for (int i = 0; i < REUSABLE_CORNER_COUNT; i++) {
-		corner[i] = BLANK;
+template<typename SampleType>
+bool MarchingCubesTables::getIsoThreshold(float isoValue, SampleType& isoThreshold)
+{
+	if (std::isnan(isoValue)) {
+		throw std::runtime_error("Iso-value is not a number");
 	}
-	for (int i = 0; i < REUSABLE_EDGE_COUNT; i++) {
-		edge[i] = BLANK;
+	if constexpr (std::is_floating_point<SampleType>::value) {
+		isoThreshold = isoValue;
+		return true;
+	}
+	else {
+		// value < isoValue is value < ceil(isoValue) for integers
+		double threshold = std::ceil((double)isoValue);
+		if (threshold > std::numeric_limits<SampleType>::max()) {
+			isoThreshold = std::numeric_limits<SampleType>::max();
+			return false;
+		}
+		isoThreshold = (SampleType)std::max(threshold, (double)std::numeric_limits<SampleType>::lowest());
+		return true;
 	}
 }
 
-void MarchedGeometry::ReusableCubeData::setCorner(uint8 cornerIndex, uint16 value) {
-	if (cornerIndex >= (CORNER_COUNT - REUSABLE_CORNER_COUNT)) {
-		corner[cornerIndex - (CORNER_COUNT - REUSABLE_CORNER_COUNT)] = value;
+// counts the lattice edges with a sign change among the lattice points of the cubes in range, that is
+// [xBegin, xEnd] x [yBegin, yEnd] x [zBegin, zEnd]. every vertex lies on such an edge and no edge generates
+// more than one vertex, so this bounds the vertex count. the sign is the one of value - isoThreshold
+template<typename SampleType>
+int64 MarchingCubesTables::countSignChangeEdges(VolumetricView<SampleType> field, CubeRange range, SampleType isoThreshold, BrickSummary<SampleType>* brickSummary)
+{
+	int64 edgeCount = 0;
+	int sizeX = field.getSizeX();
+	int sizeY = field.getSizeY();
+	int sizeZ = field.getSizeZ();
+	for (int i = range.xBegin; i <= range.xEnd; i++) {
+		for (int j = range.yBegin; j <= range.yEnd; j++) {
+			const SampleType* row = field.getRow(i, j);
+			const SampleType* nextRowX = (i < range.xEnd) ? field.getRow(i + 1, j) : NULL;
+			const SampleType* nextRowY = (j < range.yEnd) ? field.getRow(i, j + 1) : NULL;
+			int segmentBegin = range.zBegin;
+			if (brickSummary != NULL && i < sizeX - 1 && j < sizeY - 1) {
+				int brickSize = brickSummary->getBrickSize();
+				for (int k = range.zBegin; k <= range.zEnd && k < sizeZ - 1; k++) {
+					if ((k % brickSize) == 0 && brickSummary->isUniform(i / brickSize, j / brickSize, k / brickSize)) {
+						// the edges starting at the lattice points of a uniform brick have no sign change
+						edgeCount += countRowSignChangeEdges(row, nextRowX, nextRowY, segmentBegin, k, range.zEnd, isoThreshold);
+						k = std::min(k + brickSize, sizeZ - 1) - 1;
+						segmentBegin = k + 1;
+					}
+				}
+			}
+			edgeCount += countRowSignChangeEdges(row, nextRowX, nextRowY, segmentBegin, range.zEnd + 1, range.zEnd, isoThreshold);
+		}
 	}
+	return edgeCount;
 }
 
-uint16 MarchedGeometry::ReusableCubeData::getCorner(uint8 cornerIndex) {
-	if (cornerIndex >= (CORNER_COUNT - REUSABLE_CORNER_COUNT)) {
-		return corner[cornerIndex - (CORNER_COUNT - REUSABLE_CORNER_COUNT)];
+// the sign change edges starting at the lattice points [zBegin, zEnd) of a row, to the next row along x and y
+// when they aren't NULL, and to the next point of the row up to zLast
+template<typename SampleType>
+int64 MarchingCubesTables::countRowSignChangeEdges(const SampleType* row, const SampleType* nextRowX, const SampleType* nextRowY, int zBegin, int zEnd, int zLast, SampleType isoThreshold)
+{
+	int64 edgeCount = 0;
+	for (int k = zBegin; k < zEnd; k++) {
+		bool isInside = row[k] < isoThreshold;
+		if (nextRowX != NULL && isInside != (nextRowX[k] < isoThreshold)) {
+			edgeCount++;
+		}
+		if (nextRowY != NULL && isInside != (nextRowY[k] < isoThreshold)) {
+			edgeCount++;
+		}
+		if (k < zLast && isInside != (row[k + 1] < isoThreshold)) {
+			edgeCount++;
+		}
 	}
-	return BLANK;
+	return edgeCount;
 }
 
-void MarchedGeometry::ReusableCubeData::setEdge(uint8 edgeIndex, uint16 value) {
-	if (edgeIndex >= (EDGE_COUNT - REUSABLE_EDGE_COUNT)) {
-		edge[edgeIndex - (EDGE_COUNT - REUSABLE_EDGE_COUNT)] = value;
-	}
+template<typename SampleType>
+int64 MarchingCubesTables::getVertexCountUpperBound(VolumetricView<SampleType> field, SampleType isoThreshold)
+{
+	CubeRange range(0, field.getSizeX() - 1, 0, field.getSizeY() - 1, 0, field.getSizeZ() - 1);
+	return countSignChangeEdges(field, range, isoThreshold);
 }
 
-uint16 MarchedGeometry::ReusableCubeData::getEdge(uint8 edgeIndex) {
-	if (edgeIndex >= (EDGE_COUNT - REUSABLE_EDGE_COUNT)) {
-		return edge[edgeIndex - (EDGE_COUNT - REUSABLE_EDGE_COUNT)];
-	}
-	return BLANK;
+// instead of Lengyel's tables, the triangles of the 512 cases are generated on first use
+const MarchingCubesTables::TransitionCellGeometry& MarchingCubesTables::getTransitionCellGeometry(int caseIndex)
+{
+	struct TransitionCellTable {
+		TransitionCellGeometry geometry[TRANSITION_CASE_COUNT];
+		TransitionCellTable() {
+			for (int i = 0; i < TRANSITION_CASE_COUNT; i++) {
+				buildTransitionCellGeometry(i, geometry[i]);
+			}
+		}
+	};
+	static const TransitionCellTable table;
+	return table.geometry[caseIndex];
 }
 
-MarchedGeometry::ReusableCubeDoubleDeck::ReusableCubeDoubleDeck(int _cubeCountX, int _cubeCountY) {
-	cubeCountX = _cubeCountX;
-	cubeCountY = _cubeCountY;
-	deck[0] = (ReusableCubeData*)malloc(cubeCountX * cubeCountY * sizeof(ReusableCubeData));
-	deck[1] = (ReusableCubeData*)malloc(cubeCountX * cubeCountY * sizeof(ReusableCubeData));
+// the contour is traced on the faces of the cell, with the samples of each face listed counterclockwise
+// seen from outside (i along u, j along v and the coarse face at w = 1). going around a face, the contour
+// goes from the edge entering a negative sample to the next edge with a sign change, which keeps the
+// non-negative side on its left and cuts off the negative corners of ambiguous faces like the regular
+// cells do. every closed loop of the contour is triangulated as a fan
+void MarchingCubesTables::buildTransitionCellGeometry(int caseIndex, TransitionCellGeometry& geometry)
+{
+	const static int FACE_COUNT = 9;
+	const static int faceSampleCount[FACE_COUNT] = { 4, 4, 4, 4, 4, 5, 5, 5, 5 };
+	const static uint8 faceSample[FACE_COUNT][5] = {
+		{0, 3, 4, 1}, {1, 4, 5, 2}, {3, 6, 7, 4}, {4, 7, 8, 5},
+		{9, 10, 12, 11},
+		{0, 1, 2, 10, 9}, {8, 7, 6, 11, 12}, {6, 3, 0, 9, 11}, {2, 5, 8, 12, 10}
+	};
+	bool isNegative[TRANSITION_SAMPLE_COUNT];
+	for (int i = 0; i < 9; i++) {
+		isNegative[i] = ((caseIndex >> i) & 1) != 0;
+	}
+	isNegative[9] = isNegative[0];
+	isNegative[10] = isNegative[2];
+	isNegative[11] = isNegative[6];
+	isNegative[12] = isNegative[8];
+	int nextEdge[TRANSITION_EDGE_COUNT];
+	for (int i = 0; i < TRANSITION_EDGE_COUNT; i++) {
+		nextEdge[i] = -1;
+	}
+	for (int f = 0; f < FACE_COUNT; f++) {
+		int crossingEdge[5];
+		bool isEnteringNegative[5];
+		int crossingCount = 0;
+		for (int k = 0; k < faceSampleCount[f]; k++) {
+			uint8 sample0 = faceSample[f][k];
+			uint8 sample1 = faceSample[f][(k + 1) % faceSampleCount[f]];
+			if (isNegative[sample0] == isNegative[sample1]) {
+				continue;
+			}
+			// the edges between the two faces are never crossed, both of their samples are the same
+			for (int e = 0; e < TRANSITION_EDGE_COUNT; e++) {
+				if ((transitionEdgeSample[e][0] == sample0 && transitionEdgeSample[e][1] == sample1) || (transitionEdgeSample[e][0] == sample1 && transitionEdgeSample[e][1] == sample0)) {
+					crossingEdge[crossingCount] = e;
+				}
+			}
+			isEnteringNegative[crossingCount] = isNegative[sample1];
+			crossingCount++;
+		}
+		for (int c = 0; c < crossingCount; c++) {
+			if (isEnteringNegative[c]) {
+				nextEdge[crossingEdge[c]] = crossingEdge[(c + 1) % crossingCount];
+			}
+		}
+	}
+	geometry.triangleCount = 0;
+	bool isVisited[TRANSITION_EDGE_COUNT] = {};
+	for (int e = 0; e < TRANSITION_EDGE_COUNT; e++) {
+		if (nextEdge[e] < 0 || isVisited[e]) {
+			continue;
+		}
+		isVisited[e] = true;
+		int previous = nextEdge[e];
+		isVisited[previous] = true;
+		for (int current = nextEdge[previous]; current != e; current = nextEdge[current]) {
+			uint8* edgeIndex = geometry.edgeIndex + 3 * geometry.triangleCount;
+			edgeIndex[0] = e;
+			edgeIndex[1] = previous;
+			edgeIndex[2] = current;
+			geometry.triangleCount++;
+			isVisited[current] = true;
+			previous = current;
+		}
+	}
 }
 
-MarchedGeometry::ReusableCubeData& MarchedGeometry::ReusableCubeDoubleDeck::get(int deckId, int x, int y) {
-	return deck[deckId][x * cubeCountY + y];
+template class MarchedGeometry<uint16, int8>;
+template class MarchedGeometry<uint32, int8>;
+template class MarchedGeometry<uint16, uint8>;
+template class MarchedGeometry<uint32, uint8>;
+template class MarchedGeometry<uint16, int16>;
+template class MarchedGeometry<uint32, int16>;
+template class MarchedGeometry<uint16, float>;
+template class MarchedGeometry<uint32, float>;
+
+template<typename IndexType, typename SampleType>
+BatchMesher<IndexType, SampleType>::BatchMesher(int threadCount)
+{
+	if (threadCount <= 0) {
+		threadCount = std::max((int)std::thread::hardware_concurrency(), 1);
+	}
+	batchIndex = 0;
+	runningWorkerCount = 0;
+	isStopping = false;
+	chunks = NULL;
+	result = NULL;
+	callback = NULL;
+	hasError = false;
+	for (int i = 0; i < threadCount; i++) {
+		worker.push_back(new Worker());
+		worker[i]->chunkBegin = 0;
+		worker[i]->chunkEnd = 0;
+	}
+	for (int i = 0; i < threadCount; i++) {
+		worker[i]->thread = std::thread([this, i]() {
+			runWorker(i);
+		});
+	}
 }
 
-MarchedGeometry::ReusableCubeDoubleDeck::~ReusableCubeDoubleDeck() {
-	free(deck[0]);
-	free(deck[1]);
+template<typename IndexType, typename SampleType>
+BatchMesher<IndexType, SampleType>::~BatchMesher()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isStopping = true;
+	}
+	batchStarted.notify_all();
+	for (size_t i = 0; i < worker.size(); i++) {
+		worker[i]->thread.join();
+		delete worker[i];
+	}
 }
 
-void MarchedGeometry::setVertex(uint16 vertexIndex, float xPos, float yPos, float zPos)
+template<typename IndexType, typename SampleType>
+int BatchMesher<IndexType, SampleType>::getThreadCount()
 {
-	vertex[vertexIndex].position.x = xPos;
-	vertex[vertexIndex].position.y = yPos;
-	vertex[vertexIndex].position.z = zPos;
-	// TODO set normal, tangent, and texcoord
+	return (int)worker.size();
 }
 
-bool MarchedGeometry::isTriangleAreaZero(int triangleIndex)
+template<typename IndexType, typename SampleType>
+void BatchMesher<IndexType, SampleType>::runWorker(int workerIndex)
 {
-	if (triangle[triangleIndex].index[0] == triangle[triangleIndex].index[1]) {
-		return true;
+	int64 lastBatchIndex = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			batchStarted.wait(lock, [this, lastBatchIndex]() { return isStopping || batchIndex != lastBatchIndex; });
+			if (isStopping) {
+				return;
+			}
+			lastBatchIndex = batchIndex;
+		}
+		int chunkIndex;
+		// after an error the chunks left are dropped, the batch throws anyway
+		while (!hasError && takeChunk(workerIndex, chunkIndex)) {
+			try {
+				marchChunk(*worker[workerIndex], chunkIndex);
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!error) {
+					error = std::current_exception();
+				}
+				hasError = true;
+			}
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--runningWorkerCount == 0) {
+			batchFinished.notify_all();
+		}
 	}
-	if (triangle[triangleIndex].index[0] == triangle[triangleIndex].index[2]) {
-		return true;
+}
+
+// the next chunk of the worker, or the last of the half it steals from the first worker found with chunks left
+template<typename IndexType, typename SampleType>
+bool BatchMesher<IndexType, SampleType>::takeChunk(int workerIndex, int& chunkIndex)
+{
+	Worker& self = *worker[workerIndex];
+	{
+		std::lock_guard<std::mutex> lock(self.chunkMutex);
+		if (self.chunkBegin < self.chunkEnd) {
+			chunkIndex = self.chunkBegin++;
+			return true;
+		}
 	}
-	if (triangle[triangleIndex].index[1] == triangle[triangleIndex].index[2]) {
+	int workerCount = (int)worker.size();
+	for (int i = 1; i < workerCount; i++) {
+		Worker& victim = *worker[(workerIndex + i) % workerCount];
+		int stolenBegin, stolenEnd;
+		{
+			std::lock_guard<std::mutex> lock(victim.chunkMutex);
+			if (victim.chunkBegin >= victim.chunkEnd) {
+				continue;
+			}
+			stolenEnd = victim.chunkEnd;
+			stolenBegin = victim.chunkEnd - (victim.chunkEnd - victim.chunkBegin + 1) / 2;
+			victim.chunkEnd = stolenBegin;
+		}
+		std::lock_guard<std::mutex> lock(self.chunkMutex);
+		chunkIndex = stolenEnd - 1;
+		self.chunkBegin = stolenBegin;
+		self.chunkEnd = stolenEnd - 1;
 		return true;
 	}
 	return false;
 }
 
-uint16 MarchedGeometry::getNewVertexIndexOnCorner(int x, int y, int z, uint8 cornerIndex) {
-	float xPos = cubeScale.x * (x + ((cornerIndex >> 0) & 1));
-	float yPos = cubeScale.y * (y + ((cornerIndex >> 1) & 1));
-	float zPos = cubeScale.z * (z + ((cornerIndex >> 2) & 1));
-	setVertex(vertexCount, xPos, yPos, zPos);
-	return vertexCount++;
+template<typename IndexType, typename SampleType>
+void BatchMesher<IndexType, SampleType>::marchChunk(Worker& worker, int chunkIndex)
+{
+	VolumetricView<SampleType> chunk = (*chunks)[chunkIndex];
+	CubeRange range(1, chunk.getSizeX() - 2, 1, chunk.getSizeY() - 2, 1, chunk.getSizeZ() - 2);
+	Vector3D offset;
+	offset.x = -cubeScale.x;
+	offset.y = -cubeScale.y;
+	offset.z = -cubeScale.z;
+	if (result != NULL) {
+		result[chunkIndex] = new MarchedGeometry<IndexType, SampleType>(cubeScale, chunk, range, settings, worker.context, false);
+		result[chunkIndex]->translate(offset);
+	}
+	else {
+		MarchedGeometry<IndexType, SampleType> geometry(cubeScale, chunk, range, settings, worker.context, true);
+		geometry.translate(offset);
+		(*callback)(chunkIndex, geometry);
+	}
 }
 
-uint16 MarchedGeometry::getVertexIndexOnCorner(int x, int y, int z, OnEdgeVertexCode code, int32 interpolationT, ReusableCubeDoubleDeck& deck) {
-	uint32 deltaMask = getCornerDeltaMask(x, y, z);
-	uint8 cornerIndex = ((interpolationT == 0) ? code.parts.lowerNumberedCorner : code.parts.higherNumberedCorner);
-	uint16 delta = cornerIndex ^ 7;
-	uint16 maskedDelta = delta & deltaMask;
-	cornerIndex += maskedDelta;
-	x -= ((maskedDelta >> 0) & 1);
-	y -= ((maskedDelta >> 1) & 1);
-	z -= ((maskedDelta >> 2) & 1);
-	uint16 vertexIndex = deck.get(z & 1, x, y).getCorner(cornerIndex);
-	if (vertexIndex == ReusableCubeData::BLANK) {
-		vertexIndex = getNewVertexIndexOnCorner(x, y, z, cornerIndex);
-		deck.get(z & 1, x, y).setCorner(cornerIndex, vertexIndex);
+// runs the batch set in the members on the workers and waits for it
+template<typename IndexType, typename SampleType>
+void BatchMesher<IndexType, SampleType>::marchBatch()
+{
+	int chunkCount = (int)chunks->size();
+	for (int i = 0; i < chunkCount; i++) {
+		if ((*chunks)[i].getSizeX() < 3 || (*chunks)[i].getSizeY() < 3 || (*chunks)[i].getSizeZ() < 3) {
+			throw std::runtime_error("Chunk smaller than its apron in BatchMesher");
+		}
+	}
+	settings.threadCount = 1;
+	int workerCount = (int)worker.size();
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		for (int i = 0; i < workerCount; i++) {
+			std::lock_guard<std::mutex> chunkLock(worker[i]->chunkMutex);
+			worker[i]->chunkBegin = (int)((int64)chunkCount * i / workerCount);
+			worker[i]->chunkEnd = (int)((int64)chunkCount * (i + 1) / workerCount);
+		}
+		hasError = false;
+		error = std::exception_ptr();
+		runningWorkerCount = workerCount;
+		batchIndex++;
+		batchStarted.notify_all();
+		batchFinished.wait(lock, [this]() { return runningWorkerCount == 0; });
+	}
+	if (error) {
+		std::rethrow_exception(error);
 	}
-	return vertexIndex;
 }
 
-uint16 MarchedGeometry::getNewVertexIndexOnEdge(int x, int y, int z, OnEdgeVertexCode code, int32 interpolationT) {
-	float interpolatedX = (((code.parts.lowerNumberedCorner >> 0) & 1) * interpolationT + ((code.parts.higherNumberedCorner >> 0) & 1) * (0x0100 - interpolationT)) / 256.0;
-	float interpolatedY = (((code.parts.lowerNumberedCorner >> 1) & 1) * interpolationT + ((code.parts.higherNumberedCorner >> 1) & 1) * (0x0100 - interpolationT)) / 256.0;
-	float interpolatedZ = (((code.parts.lowerNumberedCorner >> 2) & 1) * interpolationT + ((code.parts.higherNumberedCorner >> 2) & 1) * (0x0100 - interpolationT)) / 256.0;
-	float xPos = cubeScale.x * (x + interpolatedX);
-	float yPos = cubeScale.y * (y + interpolatedY);
-	float zPos = cubeScale.z * (z + interpolatedZ);
-	setVertex(vertexCount, xPos, yPos, zPos);
-	return 	vertexCount++;
+template<typename IndexType, typename SampleType>
+std::vector<MarchedGeometry<IndexType, SampleType>> BatchMesher<IndexType, SampleType>::march(Vector3D cubeScale, const std::vector<VolumetricView<SampleType>>& chunks, MarchingSettings settings)
+{
+	std::lock_guard<std::mutex> batchLock(batchMutex);
+	std::vector<MarchedGeometry<IndexType, SampleType>*> chunkResult(chunks.size(), NULL);
+	this->cubeScale = cubeScale;
+	this->chunks = &chunks;
+	this->settings = settings;
+	result = chunkResult.data();
+	callback = NULL;
+	std::vector<MarchedGeometry<IndexType, SampleType>> geometry;
+	try {
+		marchBatch();
+		geometry.reserve(chunks.size());
+		for (size_t i = 0; i < chunks.size(); i++) {
+			geometry.push_back(std::move(*chunkResult[i]));
+		}
+	}
+	catch (...) {
+		for (size_t i = 0; i < chunkResult.size(); i++) {
+			delete chunkResult[i];
+		}
+		throw;
+	}
+	for (size_t i = 0; i < chunkResult.size(); i++) {
+		delete chunkResult[i];
+	}
+	return geometry;
 }
 
-uint16 MarchedGeometry::getVertexIndexOnEdge(int x, int y, int z, OnEdgeVertexCode code, int32 interpolationT, ReusableCubeDoubleDeck& deck) {
-	uint32 deltaMask = getEdgeDeltaMask(x, y, z);
-	uint32 edgeDelta = code.parts.edgeDelta;
-	uint16 edgeIndex = code.parts.edgeIndex;
-	uint16 maskedDelta = edgeDelta & deltaMask;
-	edgeIndex += (maskedDelta & 1) * 3 + ((maskedDelta >> 1) & 1) * 3 + ((maskedDelta >> 2) & 1) * 3 + ((maskedDelta >> 3) & 1) * 6;
-	x -= ((maskedDelta >> 0) & 1);
-	y -= ((maskedDelta >> 1) & 1);
-	z -= ((maskedDelta >> 3) & 1);
-	uint16 vertexIndex = deck.get(z & 1, x, y).getEdge(edgeIndex);
-	if (vertexIndex == ReusableCubeData::BLANK) {
-		vertexIndex = getNewVertexIndexOnEdge(x, y, z, code, interpolationT);
-		deck.get(z & 1, x, y).setEdge(edgeIndex, vertexIndex);
-	}
-	return vertexIndex;
+template<typename IndexType, typename SampleType>
+void BatchMesher<IndexType, SampleType>::march(Vector3D cubeScale, const std::vector<VolumetricView<SampleType>>& chunks, Callback callback, MarchingSettings settings)
+{
+	std::lock_guard<std::mutex> batchLock(batchMutex);
+	this->cubeScale = cubeScale;
+	this->chunks = &chunks;
+	this->settings = settings;
+	result = NULL;
+	this->callback = &callback;
+	marchBatch();
 }
 
-void MarchedGeometry::marchCube(int x, int y, int z, ReusableCubeDoubleDeck& deck)
+template class BatchMesher<uint16, int8>;
+template class BatchMesher<uint32, int8>;
+template class BatchMesher<uint16, uint8>;
+template class BatchMesher<uint32, uint8>;
+template class BatchMesher<uint16, int16>;
+template class BatchMesher<uint32, int16>;
+template class BatchMesher<uint16, float>;
+template class BatchMesher<uint32, float>;
+
+template<typename IndexType>
+BrickedGeometry<IndexType>::BrickedGeometry(Vector3D cubeScale, VolumetricData<int8>& field, MarchingSettings settings)
 {
-	deck.get(z & 1, x, y).reset();
-	uint16 cubeVertexIndex[MAX_VERTEX_PER_CUBE];
-	uint32 caseIndex = this->getCaseIndex(x, y, z);
-	uint8 classIndex = caseIndexToClassIndex[caseIndex];
-	ClassGeometry geometry = classGeometry[classIndex];
-	for (int i = 0; i < geometry.geometryCounts.vertexCount; i++) {
-		OnEdgeVertexCode code = onEdgeVertexCode[caseIndex][i];
-		int32 interpolationT = getInterpolationT(x, y, z, code);
-		if (interpolationT == 0 || interpolationT == 0x0100) {
-			cubeVertexIndex[i] = getVertexIndexOnCorner(x, y, z, code, interpolationT, deck);
+	this->cubeScale = cubeScale;
+	this->settings = settings;
+	cubeCountX = std::max(field.getSizeX() - 1, 0);
+	cubeCountY = std::max(field.getSizeY() - 1, 0);
+	cubeCountZ = std::max(field.getSizeZ() - 1, 0);
+	brickCountX = (cubeCountX + BRICK_SIZE - 1) / BRICK_SIZE;
+	brickCountY = (cubeCountY + BRICK_SIZE - 1) / BRICK_SIZE;
+	brickCountZ = (cubeCountZ + BRICK_SIZE - 1) / BRICK_SIZE;
+	piece.assign((size_t)brickCountX * brickCountY * brickCountZ, NULL);
+	int threadCount = settings.threadCount;
+	if (threadCount <= 0) {
+		threadCount = std::thread::hardware_concurrency();
+	}
+	threadCount = std::max(std::min(threadCount, brickCountX), 1);
+	int brickPlaneCount = brickCountY * brickCountZ;
+	try {
+		if (threadCount == 1) {
+			for (size_t i = 0; i < piece.size(); i++) {
+				marchBrick(field, (int)i);
+			}
 		}
 		else {
-			cubeVertexIndex[i] = getVertexIndexOnEdge(x, y, z, code, interpolationT, deck);
+			// every thread marches the bricks of its own x-slab, same as MarchedGeometry
+			std::vector<std::thread> workers;
+			std::vector<std::exception_ptr> errors(threadCount);
+			for (int t = 0; t < threadCount; t++) {
+				workers.push_back(std::thread([this, &field, &errors, t, threadCount, brickPlaneCount]() {
+					try {
+						int xBegin = (int)((int64)brickCountX * t / threadCount);
+						int xEnd = (int)((int64)brickCountX * (t + 1) / threadCount);
+						for (int i = xBegin * brickPlaneCount; i < xEnd * brickPlaneCount; i++) {
+							marchBrick(field, i);
+						}
+					}
+					catch (...) {
+						errors[t] = std::current_exception();
+					}
+				}));
+			}
+			for (int t = 0; t < threadCount; t++) {
+				workers[t].join();
+			}
+			for (int t = 0; t < threadCount; t++) {
+				if (errors[t]) {
+					std::rethrow_exception(errors[t]);
+				}
+			}
 		}
 	}
-	for (int i = 0; i < geometry.geometryCounts.triangleCount; i++) {
-		for (int j = 0; j < 3; j++) {
-			triangle[triangleCount].index[j] = cubeVertexIndex[geometry.vertexIndex[3 * i + j]];
+	catch (...) {
+		releasePieces();
+		throw;
+	}
+	field.clearDirtyBricks();
+}
+
+template<typename IndexType>
+BrickedGeometry<IndexType>::BrickedGeometry(BrickedGeometry&& geometry)
+{
+	*this = std::move(geometry);
+}
+
+template<typename IndexType>
+BrickedGeometry<IndexType>& BrickedGeometry<IndexType>::operator=(BrickedGeometry&& geometry)
+{
+	if (this != &geometry) {
+		releasePieces();
+		cubeScale = geometry.cubeScale;
+		settings = geometry.settings;
+		cubeCountX = geometry.cubeCountX;
+		cubeCountY = geometry.cubeCountY;
+		cubeCountZ = geometry.cubeCountZ;
+		brickCountX = geometry.brickCountX;
+		brickCountY = geometry.brickCountY;
+		brickCountZ = geometry.brickCountZ;
+		piece = std::move(geometry.piece);
+		geometry.piece.clear();
+		geometry.brickCountX = 0;
+		geometry.brickCountY = 0;
+		geometry.brickCountZ = 0;
+	}
+	return *this;
+}
+
+template<typename IndexType>
+BrickedGeometry<IndexType>::~BrickedGeometry()
+{
+	releasePieces();
+}
+
+template<typename IndexType>
+void BrickedGeometry<IndexType>::releasePieces()
+{
+	for (size_t i = 0; i < piece.size(); i++) {
+		delete piece[i];
+		piece[i] = NULL;
+	}
+}
+
+// the piece is replaced only once the brick is marched, so it is kept if marching throws
+template<typename IndexType>
+void BrickedGeometry<IndexType>::marchBrick(VolumetricData<int8>& field, int brickIndex)
+{
+	int brickX = brickIndex / (brickCountY * brickCountZ);
+	int brickY = (brickIndex / brickCountZ) % brickCountY;
+	int brickZ = brickIndex % brickCountZ;
+	CubeRange range(brickX * BRICK_SIZE, std::min((brickX + 1) * BRICK_SIZE, cubeCountX),
+		brickY * BRICK_SIZE, std::min((brickY + 1) * BRICK_SIZE, cubeCountY),
+		brickZ * BRICK_SIZE, std::min((brickZ + 1) * BRICK_SIZE, cubeCountZ));
+	MarchingSettings pieceSettings = settings;
+	pieceSettings.threadCount = 1;
+	pieceSettings.skipEmptyBricks = false;
+	MarchedGeometry<IndexType>* newPiece = new MarchedGeometry<IndexType>(cubeScale, field, range, pieceSettings);
+	if (newPiece->getTriangleCount() == 0) {
+		delete newPiece;
+		newPiece = NULL;
+	}
+	delete piece[brickIndex];
+	piece[brickIndex] = newPiece;
+}
+
+template<typename IndexType>
+int BrickedGeometry<IndexType>::remesh(VolumetricData<int8>& field)
+{
+	if (field.getSizeX() - 1 != cubeCountX || field.getSizeY() - 1 != cubeCountY || field.getSizeZ() - 1 != cubeCountZ) {
+		throw std::runtime_error("VolumetricData dimentions don't match the BrickedGeometry");
+	}
+	const std::vector<int>& dirtyBrick = field.getDirtyBricks();
+	int remeshedCount = (int)dirtyBrick.size();
+	for (size_t i = 0; i < dirtyBrick.size(); i++) {
+		marchBrick(field, dirtyBrick[i]);
+	}
+	field.clearDirtyBricks();
+	return remeshedCount;
+}
+
+template<typename IndexType>
+int BrickedGeometry<IndexType>::getBrickCountX()
+{
+	return brickCountX;
+}
+
+template<typename IndexType>
+int BrickedGeometry<IndexType>::getBrickCountY()
+{
+	return brickCountY;
+}
+
+template<typename IndexType>
+int BrickedGeometry<IndexType>::getBrickCountZ()
+{
+	return brickCountZ;
+}
+
+template<typename IndexType>
+MarchedGeometry<IndexType>* BrickedGeometry<IndexType>::getPiece(int brickX, int brickY, int brickZ)
+{
+	if (brickX < 0 || brickX >= brickCountX || brickY < 0 || brickY >= brickCountY || brickZ < 0 || brickZ >= brickCountZ) {
+		throw std::runtime_error("Brick out of bound in BrickedGeometry getPiece function");
+	}
+	return piece[((size_t)brickX * brickCountY + brickY) * brickCountZ + brickZ];
+}
+
+template<typename IndexType>
+int BrickedGeometry<IndexType>::getVertexCount()
+{
+	int count = 0;
+	for (size_t i = 0; i < piece.size(); i++) {
+		count += (piece[i] != NULL) ? piece[i]->getVertexCount() : 0;
+	}
+	return count;
+}
+
+template<typename IndexType>
+int BrickedGeometry<IndexType>::getTriangleCount()
+{
+	int count = 0;
+	for (size_t i = 0; i < piece.size(); i++) {
+		count += (piece[i] != NULL) ? piece[i]->getTriangleCount() : 0;
+	}
+	return count;
+}
+
+template class BrickedGeometry<uint16>;
+template class BrickedGeometry<uint32>;
+
+template<typename IndexType>
+LodGeometry<IndexType>::LodGeometry(Vector3D cubeScale, VolumetricView<int8> field, int lod, int transitionFaces, float transitionWidth, MarchingSettings settings)
+{
+	if (lod < 0 || lod > 16) {
+		throw std::runtime_error("Invalid level of detail in LodGeometry");
+	}
+	if (transitionFaces != 0 && lod == 0) {
+		throw std::runtime_error("Transition faces need a level of detail above 0 in LodGeometry");
+	}
+	if (transitionWidth < 0 || transitionWidth >= 1) {
+		throw std::runtime_error("Transition width must be in [0, 1) in LodGeometry");
+	}
+	if (settings.computeNormals) {
+		throw std::runtime_error("Normals are not supported in LodGeometry");
+	}
+	if (settings.isoValue != 0) {
+		throw std::runtime_error("Iso-values other than 0 are not supported in LodGeometry");
+	}
+	this->lod = lod;
+	int stride = getStride();
+	int cubeCountX = field.getSizeX() - 1, cubeCountY = field.getSizeY() - 1, cubeCountZ = field.getSizeZ() - 1;
+	if (cubeCountX < 1 || cubeCountY < 1 || cubeCountZ < 1 || cubeCountX % stride != 0 || cubeCountY % stride != 0 || cubeCountZ % stride != 0) {
+		throw std::runtime_error("VolumetricData dimentions don't fit the stride of LodGeometry");
+	}
+	// the regular cells are marched over every stride-th sample
+	VolumetricData<int8> coarseField(cubeCountX / stride + 1, cubeCountY / stride + 1, cubeCountZ / stride + 1);
+	for (int x = 0; x < coarseField.getSizeX(); x++) {
+		int8* slice = coarseField.getWritableSlice(x);
+		for (int y = 0; y < coarseField.getSizeY(); y++) {
+			const int8* row = field.getRow(x * stride, y * stride);
+			for (int z = 0; z < coarseField.getSizeZ(); z++) {
+				slice[y * coarseField.getSizeZ() + z] = row[z * stride];
+			}
 		}
-		if (!isTriangleAreaZero(triangleCount)) {
-			triangleCount++;
+	}
+	Vector3D coarseScale;
+	coarseScale.x = cubeScale.x * stride;
+	coarseScale.y = cubeScale.y * stride;
+	coarseScale.z = cubeScale.z * stride;
+	// the boundary cells are moved in floats, the regular mesh is copied out of its MarchedGeometry
+	MarchingSettings regularSettings = settings;
+	regularSettings.compactVertices = false;
+	MarchedGeometry<IndexType> regular(coarseScale, coarseField, regularSettings);
+	vertex.assign(regular.getVertices(), regular.getVertices() + regular.getVertexCount());
+	triangle.assign(regular.getTriangles(), regular.getTriangles() + regular.getTriangleCount());
+	shrinkBoundaryCells(cubeScale, field, transitionFaces, transitionWidth);
+	transitionTriangleCount = 0;
+	for (int face = 0; face < 6; face++) {
+		if ((transitionFaces >> face) & 1) {
+			marchTransitionFace(cubeScale, field, face, transitionWidth);
 		}
 	}
+	transitionTriangleCount = (int)triangle.size() - regular.getTriangleCount();
 }
 
-void MarchedGeometry::marchCubes()
+// the positions in the outer cell layer along a transition face are mapped from [0, 1] to
+// [transitionWidth, 1] cells away from the face
+template<typename IndexType>
+void LodGeometry<IndexType>::shrinkBoundaryCells(Vector3D cubeScale, VolumetricView<int8> field, int transitionFaces, float transitionWidth)
 {
-	ReusableCubeDoubleDeck reusableCubeDoubleDeck = ReusableCubeDoubleDeck(cubeCountX, cubeCountY);
-	for (int k = 0; k < cubeCountZ; k++) {
-		for (int j = 0; j < cubeCountY; j++) {
-			for (int i = 0; i < cubeCountX; i++) {
-				marchCube(i, j, k, reusableCubeDoubleDeck);
+	float scale[3] = { cubeScale.x, cubeScale.y, cubeScale.z };
+	int size[3] = { field.getSizeX(), field.getSizeY(), field.getSizeZ() };
+	for (int face = 0; face < 6; face++) {
+		if (((transitionFaces >> face) & 1) == 0) {
+			continue;
+		}
+		int axis = face >> 1;
+		bool isPositive = (face & 1) != 0;
+		float cellSize = scale[axis] * getStride();
+		float facePosition = isPositive ? scale[axis] * (size[axis] - 1) : 0.0f;
+		for (size_t i = 0; i < vertex.size(); i++) {
+			float* position = &vertex[i].position.x;
+			float distance = isPositive ? facePosition - position[axis] : position[axis] - facePosition;
+			if (distance < cellSize) {
+				distance = cellSize * transitionWidth + distance * (1 - transitionWidth);
+				position[axis] = isPositive ? facePosition - distance : facePosition + distance;
 			}
 		}
 	}
 }
 
-void MarchedGeometry::toFile(const char filename[]) {
-	std::ofstream fout(filename);
-	if (!fout.is_open()) {
-		throw std::runtime_error("Can't open file");
-	}
-	fout << vertexCount << std::endl;
-	for (int i = 0; i < vertexCount; i++) {
-		fout << vertex[i].position.x << " " << vertex[i].position.y << " " << vertex[i].position.z << std::endl;
+// face is 2 * axis for the negative face of the axis and 2 * axis + 1 for the positive one. the cell is
+// laid out with u along the next axis, v along the one after and w into the chunk, which mirrors the
+// cell on the positive faces, so their triangles are flipped
+template<typename IndexType>
+void LodGeometry<IndexType>::marchTransitionFace(Vector3D cubeScale, VolumetricView<int8> field, int face, float transitionWidth)
+{
+	int axis = face >> 1;
+	int uAxis = (axis + 1) % 3;
+	int vAxis = (axis + 2) % 3;
+	bool isPositive = (face & 1) != 0;
+	float scale[3] = { cubeScale.x, cubeScale.y, cubeScale.z };
+	int size[3] = { field.getSizeX(), field.getSizeY(), field.getSizeZ() };
+	int stride = getStride();
+	int halfStride = stride / 2;
+	int faceSample = isPositive ? size[axis] - 1 : 0;
+	float cellDepth = scale[axis] * stride * transitionWidth;
+	float fineFacePosition = scale[axis] * faceSample;
+	float coarseFacePosition = isPositive ? fineFacePosition - cellDepth : fineFacePosition + cellDepth;
+	const static int coarseSample[4] = { 0, 2, 6, 8 };
+	for (int u = 0; u < (size[uAxis] - 1) / stride; u++) {
+		for (int v = 0; v < (size[vAxis] - 1) / stride; v++) {
+			int8 sampleValue[TRANSITION_SAMPLE_COUNT];
+			float samplePosition[TRANSITION_SAMPLE_COUNT][3];
+			int caseIndex = 0;
+			for (int i = 0; i < 9; i++) {
+				int sample[3];
+				sample[axis] = faceSample;
+				sample[uAxis] = u * stride + (i % 3) * halfStride;
+				sample[vAxis] = v * stride + (i / 3) * halfStride;
+				sampleValue[i] = field.getUnchecked(sample[0], sample[1], sample[2]);
+				for (int a = 0; a < 3; a++) {
+					samplePosition[i][a] = scale[a] * sample[a];
+				}
+				caseIndex |= ((sampleValue[i] >> 7) & 1) << i;
+			}
+			if (caseIndex == 0 || caseIndex == TRANSITION_CASE_COUNT - 1) {
+				continue;
+			}
+			for (int i = 0; i < 4; i++) {
+				sampleValue[9 + i] = sampleValue[coarseSample[i]];
+				for (int a = 0; a < 3; a++) {
+					samplePosition[9 + i][a] = samplePosition[coarseSample[i]][a];
+				}
+				samplePosition[9 + i][axis] = coarseFacePosition;
+			}
+			// a vertex on an edge, or on a sample if the edge is crossed right at it
+			IndexType cellVertexIndex[TRANSITION_EDGE_COUNT + TRANSITION_SAMPLE_COUNT];
+			bool hasVertex[TRANSITION_EDGE_COUNT + TRANSITION_SAMPLE_COUNT] = {};
+			const TransitionCellGeometry& geometry = getTransitionCellGeometry(caseIndex);
+			for (int t = 0; t < geometry.triangleCount; t++) {
+				IndexedTriangle<IndexType> newTriangle;
+				for (int j = 0; j < 3; j++) {
+					uint8 edge = geometry.edgeIndex[3 * t + j];
+					uint8 sample0 = transitionEdgeSample[edge][0], sample1 = transitionEdgeSample[edge][1];
+					// the same interpolation as the regular cells, so the vertices match the ones of both neighbors
+					int32 interpolationT = getByteInterpolationT(sampleValue[sample0], sampleValue[sample1]);
+					int key = edge;
+					if (interpolationT == 0 || interpolationT == 0x0100) {
+						key = TRANSITION_EDGE_COUNT + ((interpolationT == 0) ? sample1 : sample0);
+					}
+					if (!hasVertex[key]) {
+						float position[3];
+						for (int a = 0; a < 3; a++) {
+							position[a] = (samplePosition[sample0][a] * interpolationT + samplePosition[sample1][a] * (0x0100 - interpolationT)) / 256.0f;
+						}
+						cellVertexIndex[key] = addVertex(position);
+						hasVertex[key] = true;
+					}
+					newTriangle.index[isPositive ? 2 - j : j] = cellVertexIndex[key];
+				}
+				if (newTriangle.index[0] != newTriangle.index[1] && newTriangle.index[0] != newTriangle.index[2] && newTriangle.index[1] != newTriangle.index[2]) {
+					triangle.push_back(newTriangle);
+				}
+			}
+		}
 	}
-	fout << triangleCount << std::endl;
-	for (int i = 0; i < triangleCount; i++) {
-		fout << triangle[i].index[0] << " " << triangle[i].index[1] << " " << triangle[i].index[2] << std::endl;
+}
+
+template<typename IndexType>
+IndexType LodGeometry<IndexType>::addVertex(const float position[3])
+{
+	if (vertex.size() >= (size_t)(IndexType)~0) {
+		throw std::runtime_error("Too many vertices for the index type in LodGeometry");
 	}
-	fout.close();
+	Vertex newVertex;
+	newVertex.position.x = position[0];
+	newVertex.position.y = position[1];
+	newVertex.position.z = position[2];
+	vertex.push_back(newVertex);
+	return (IndexType)(vertex.size() - 1);
+}
+
+template<typename IndexType>
+int LodGeometry<IndexType>::getLod()
+{
+	return lod;
+}
+
+template<typename IndexType>
+int LodGeometry<IndexType>::getStride()
+{
+	return 1 << lod;
+}
+
+template<typename IndexType>
+int LodGeometry<IndexType>::getVertexCount()
+{
+	return (int)vertex.size();
+}
+
+template<typename IndexType>
+int LodGeometry<IndexType>::getTriangleCount()
+{
+	return (int)triangle.size();
+}
+
+template<typename IndexType>
+int LodGeometry<IndexType>::getTransitionTriangleCount()
+{
+	return transitionTriangleCount;
+}
+
+template<typename IndexType>
+const Vertex* LodGeometry<IndexType>::getVertices()
+{
+	return vertex.data();
+}
+
+template<typename IndexType>
+const IndexedTriangle<IndexType>* LodGeometry<IndexType>::getTriangles()
+{
+	return triangle.data();
 }
 
-const uint8 MarchedGeometry::caseIndexToClassIndex[MarchedGeometry::CASE_COUNT] = {
+template class LodGeometry<uint16>;
+template class LodGeometry<uint32>;
+
+constexpr const uint8 MarchingCubesTables::caseIndexToClassIndex[MarchingCubesTables::CASE_COUNT] = {
 	0x00, 0x01, 0x01, 0x03, 0x01, 0x03, 0x02, 0x04, 0x01, 0x02, 0x03, 0x04, 0x03, 0x04, 0x04, 0x03,
 	0x01, 0x03, 0x02, 0x04, 0x02, 0x04, 0x06, 0x0C, 0x02, 0x05, 0x05, 0x0B, 0x05, 0x0A, 0x07, 0x04,
 	0x01, 0x02, 0x03, 0x04, 0x02, 0x05, 0x05, 0x0A, 0x02, 0x06, 0x04, 0x0C, 0x05, 0x07, 0x0B, 0x04,
@@ -274,7 +3238,7 @@ const uint8 MarchedGeometry::caseIndexToClassIndex[MarchedGeometry::CASE_COUNT]
 	0x03, 0x04, 0x04, 0x03, 0x04, 0x03, 0x0D, 0x01, 0x04, 0x0D, 0x03, 0x01, 0x03, 0x01, 0x01, 0x00
 };
 
-const typename MarchedGeometry::ClassGeometry MarchedGeometry::classGeometry[MarchedGeometry::CLASS_COUNT] = {
+constexpr const MarchingCubesTables::ClassGeometry MarchingCubesTables::classGeometry[MarchingCubesTables::CLASS_COUNT] = {
 	{0x00, {}},
 	{0x31, {0, 1, 2}},
 	{0x62, {0, 1, 2, 3, 4, 5}},
@@ -293,7 +3257,7 @@ const typename MarchedGeometry::ClassGeometry MarchedGeometry::classGeometry[Mar
 	{0x95, {0, 4, 5, 0, 3, 4, 0, 1, 3, 1, 2, 3, 6, 7, 8}}
 };
 
-const typename MarchedGeometry::OnEdgeVertexCode MarchedGeometry::onEdgeVertexCode[MarchedGeometry::CASE_COUNT][MarchedGeometry::MAX_VERTEX_PER_CUBE] = {
+constexpr const MarchingCubesTables::OnEdgeVertexCode MarchingCubesTables::onEdgeVertexCode[MarchingCubesTables::CASE_COUNT][MarchingCubesTables::MAX_VERTEX_PER_CUBE] = {
 	{},
 	{0xA188, 0x9050, 0x72E0},
 	{0xA188, 0x65E9, 0x8359},
@@ -551,3 +3515,47 @@ const typename MarchedGeometry::OnEdgeVertexCode MarchedGeometry::onEdgeVertexCo
 	{0xA188, 0x72E0, 0x9050},
 	{}
 };
+
+// reads the counts and codes through their values, the bitfields of the unions can't be read at compile time
+constexpr std::array<MarchingCubesTables::CaseGeometry, MarchingCubesTables::CASE_COUNT> MarchingCubesTables::buildCaseGeometry()
+{
+	std::array<CaseGeometry, CASE_COUNT> table = {};
+	for (int caseIndex = 0; caseIndex < CASE_COUNT; caseIndex++) {
+		const ClassGeometry& geometry = classGeometry[caseIndexToClassIndex[caseIndex]];
+		CaseGeometry& entry = table[caseIndex];
+		entry.triangleCount = geometry.value & 0x0F;
+		entry.vertexCount = geometry.value >> 4;
+		for (int i = 0; i < MAX_TRIANGLE_PER_CUBE * 3; i++) {
+			entry.vertexIndex[i] = geometry.vertexIndex[i];
+		}
+		for (int i = 0; i < entry.vertexCount; i++) {
+			uint16 code = onEdgeVertexCode[caseIndex][i].value;
+			uint8 lowerNumberedCorner = code & 0x07, higherNumberedCorner = (code >> 3) & 0x07;
+			entry.cornerPair[i] = (uint8)(lowerNumberedCorner | (higherNumberedCorner << 4));
+			entry.edgeIndex[i] = (code >> 8) & 0x0F;
+			entry.edgeDelta[i] = code >> 12;
+		}
+	}
+	return table;
+}
+
+constexpr std::array<MarchingCubesTables::CaseGeometry, MarchingCubesTables::CASE_COUNT> MarchingCubesTables::caseGeometry = MarchingCubesTables::buildCaseGeometry();
+
+// the dividends are at most 255 * 256, below 1 << 16, and the divisors at most 255, below 1 << 8. rounding
+// the reciprocals up with 16 + 8 bits of precision keeps every quotient exact
+constexpr std::array<uint32, 256> MarchingCubesTables::buildInterpolationReciprocal()
+{
+	std::array<uint32, 256> table = {};
+	for (uint32 divisor = 1; divisor < 256; divisor++) {
+		table[divisor] = (uint32)(((1ull << INTERPOLATION_RECIPROCAL_SHIFT) + divisor - 1) / divisor);
+	}
+	return table;
+}
+
+alignas(64) constexpr std::array<uint32, 256> MarchingCubesTables::interpolationReciprocal = MarchingCubesTables::buildInterpolationReciprocal();
+
+const uint8 MarchingCubesTables::transitionEdgeSample[MarchingCubesTables::TRANSITION_EDGE_COUNT][2] = {
+	{0, 1}, {1, 2}, {3, 4}, {4, 5}, {6, 7}, {7, 8},
+	{0, 3}, {1, 4}, {2, 5}, {3, 6}, {4, 7}, {5, 8},
+	{9, 10}, {11, 12}, {9, 11}, {10, 12}
+};
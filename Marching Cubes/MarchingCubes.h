@@ -1,16 +1,47 @@
 #include<fstream>
 #include<vector>
+#include<stdexcept>
+#include<atomic>
+#include<algorithm>
+#include<cstring>
+#include<cstdlib>
+#include<iterator>
+#include<functional>
+#include<string>
+#include<utility>
+#include<type_traits>
+#include<array>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<exception>
+#include<cmath>
+#include<limits>
 
 #pragma once
 
+// the unchecked accessors of VolumetricData skip the bound checks unless MARCHING_CUBES_VALIDATE is defined,
+// which is the default for debug builds
+#if defined(_DEBUG) && !defined(MARCHING_CUBES_VALIDATE)
+#define MARCHING_CUBES_VALIDATE
+#endif
+
+// the counters and timers of MarchingStats are only collected when MARCHING_CUBES_STATS is defined,
+// otherwise the instrumentation compiles to nothing
+#ifdef MARCHING_CUBES_STATS
+#define MARCHING_CUBES_STATS_ONLY(...) __VA_ARGS__
+#else
+#define MARCHING_CUBES_STATS_ONLY(...)
+#endif
+
 typedef signed char				int8;
 typedef short					int16;
 typedef int						int32;
-typedef __int64					int64;
+typedef long long				int64;
 typedef unsigned char			uint8;
 typedef unsigned short			uint16;
 typedef unsigned int			uint32;
-typedef unsigned __int64		uint64;
+typedef unsigned long long		uint64;
 
 struct Vector3D {
 	float x;
@@ -18,14 +49,128 @@ struct Vector3D {
 	float z;
 	Vector3D(int _x = 0, int _y = 0, int _z = 0);
 	Vector3D(const Vector3D& v);
+	Vector3D& operator=(const Vector3D& v) = default;
 };
 
 struct Vertex {
 	Vector3D position;
 };
 
-struct Triangle {
-	uint16 index[3];
+// a vertex position in 16-bit fixed point, at offset + position * scale along each axis, with the offset and
+// scale of its mesh
+struct CompactVertex {
+	uint16 position[3];
+};
+
+template<typename IndexType>
+struct IndexedTriangle {
+	IndexType index[3];
+};
+
+typedef IndexedTriangle<uint16> Triangle;
+typedef IndexedTriangle<uint32> Triangle32;
+
+// the binary volume file is a VolumeFileHeader followed by the samples at dataOffset, all little-endian
+enum VolumeSampleType : uint8 {
+	VOLUME_SAMPLE_INT8 = 0,
+	VOLUME_SAMPLE_UINT8 = 1,
+	VOLUME_SAMPLE_INT16 = 2,
+	VOLUME_SAMPLE_UINT16 = 3,
+	VOLUME_SAMPLE_INT32 = 4,
+	VOLUME_SAMPLE_FLOAT32 = 5
+};
+
+enum VolumeLayout : uint8 {
+	VOLUME_LAYOUT_XYZ = 0, // z is contiguous, the layout of VolumetricData
+	VOLUME_LAYOUT_ZYX = 1  // x is contiguous
+};
+
+enum VolumeCompression : uint8 {
+	VOLUME_COMPRESSION_NONE = 0,
+	VOLUME_COMPRESSION_RLE = 1 // runs of a uint32 length followed by one sample
+};
+
+struct VolumeFileHeader {
+	char magic[4];
+	uint32 version;
+	int32 sizeX, sizeY, sizeZ;
+	uint8 sampleType;
+	uint8 layout;
+	uint8 compression;
+	uint8 reserved;
+	uint64 dataOffset;
+	uint64 dataByteCount;
+	uint8 padding[24];
+	const static uint32 VERSION = 1;
+	const static char MAGIC[4];
+	VolumeFileHeader();
+	bool hasValidMagic();
+	// throws if the header doesn't describe sampleType samples that fit in a file of fileByteCount bytes
+	void validate(VolumeSampleType sampleType, uint64 fileByteCount, uint64 sampleSize);
+};
+
+template<typename T> struct VolumeSampleTypeOf;
+template<> struct VolumeSampleTypeOf<int8> { const static VolumeSampleType value = VOLUME_SAMPLE_INT8; };
+template<> struct VolumeSampleTypeOf<uint8> { const static VolumeSampleType value = VOLUME_SAMPLE_UINT8; };
+template<> struct VolumeSampleTypeOf<int16> { const static VolumeSampleType value = VOLUME_SAMPLE_INT16; };
+template<> struct VolumeSampleTypeOf<uint16> { const static VolumeSampleType value = VOLUME_SAMPLE_UINT16; };
+template<> struct VolumeSampleTypeOf<int32> { const static VolumeSampleType value = VOLUME_SAMPLE_INT32; };
+template<> struct VolumeSampleTypeOf<float> { const static VolumeSampleType value = VOLUME_SAMPLE_FLOAT32; };
+
+// copy-on-write memory mapping of a whole file, writing to it never changes the file
+class MappedFile
+{
+private:
+	uint8* address;
+	int64 byteCount;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+public:
+	MappedFile(const char filename[]);
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+	uint8* getData();
+	int64 getByteCount();
+};
+
+// true if the file starts with the magic of a VolumeFileHeader
+bool isBinaryVolumeFile(const char filename[]);
+
+template<typename T> class VolumetricData;
+
+// non-owning view of samples stored by someone else, a VolumetricData, a box inside one, or an external
+// array. the samples of a row (x, y) are sizeZ contiguous values, and the rows are strideX and strideY
+// samples apart along x and y. the samples must outlive the view, copying a view never copies them
+template<typename T>
+class VolumetricView
+{
+private:
+	const T* data;
+	int sizeX, sizeY, sizeZ;
+	int64 strideX, strideY;
+public:
+	// empty view
+	VolumetricView();
+	// densely packed samples, z contiguous then y then x, the layout of VolumetricData
+	VolumetricView(const T data[], int sizeX, int sizeY, int sizeZ);
+	VolumetricView(const T data[], int sizeX, int sizeY, int sizeZ, int64 strideX, int64 strideY);
+	VolumetricView(const VolumetricData<T>& volumetricData);
+	T get(int x, int y, int z) const;
+	T getUnchecked(int x, int y, int z) const;
+	// pointer to the sizeZ contiguous values at (x, y)
+	const T* getRow(int x, int y) const;
+	int getSizeX() const;
+	int getSizeY() const;
+	int getSizeZ() const;
+	int64 getStrideX() const;
+	int64 getStrideY() const;
+	// view of the sizeX * sizeY * sizeZ samples starting at (x, y, z), sharing the samples of this view
+	VolumetricView getSubView(int x, int y, int z, int sizeX, int sizeY, int sizeZ) const;
 };
 
 template<typename T>
@@ -34,20 +179,302 @@ class VolumetricData
 private:
 	int sizeX, sizeY, sizeZ;
 	T *data;
+	// the mapping data points into, if the data was loaded from an uncompressed binary file
+	MappedFile* mappedFile;
+	// one flag per brick of DIRTY_BRICK_SIZE^3 cubes edited since the last clearDirtyBricks, allocated on
+	// the first edit, and the indices of the flagged bricks
+	std::vector<uint8> dirtyBrickFlag;
+	std::vector<int> dirtyBrick;
+	int getBrickCount(int sampleCount);
+	// takes the ownership of data, which is either malloc-ed or points into mappedFile
+	VolumetricData(int sizeX, int sizeY, int sizeZ, T data[], MappedFile* mappedFile);
+	static VolumetricData fromTextFile(const char filename[]);
 public:
 	VolumetricData(int sizeX, int sizeY, int sizeZ, T data[]);
+	// zero-filled volume
+	VolumetricData(int sizeX, int sizeY, int sizeZ);
 	VolumetricData(const VolumetricData<T>& volumetricData);
+	// takes the samples of volumetricData, which is left empty
+	VolumetricData(VolumetricData<T>&& volumetricData);
+	VolumetricData& operator=(const VolumetricData<T>& volumetricData);
+	VolumetricData& operator=(VolumetricData<T>&& volumetricData);
 	T get(int x, int y, int z);
+	T getUnchecked(int x, int y, int z);
+	// pointer to the sizeZ contiguous values at (x, y)
+	const T* getRow(int x, int y);
+	// pointer to the sizeY * sizeZ contiguous values at x
+	const T* getSlice(int x);
+	T* getWritableSlice(int x);
+	VolumetricView<T> getView() const;
+	const static int DIRTY_BRICK_SIZE = 8;
+	// sets a sample and marks as dirty the bricks of the cubes that use it, and of the ring of cubes
+	// around them, whose normals depend on it
+	void set(int x, int y, int z, T value);
+	bool isBrickDirty(int brickX, int brickY, int brickZ);
+	// index (brickX * brickCountY + brickY) * brickCountZ + brickZ of each dirty brick
+	const std::vector<int>& getDirtyBricks();
+	void clearDirtyBricks();
 	int getSizeX();
 	int getSizeY();
 	int getSizeZ();
 	~VolumetricData();
+	// reads either format, detected by the magic of the binary format
 	static VolumetricData fromFile(const char filename[]);
+	// maps the file, so the samples of an uncompressed file in the xyz layout are not copied
+	static VolumetricData fromBinaryFile(const char filename[]);
 	void toFile(const char filename[]);
+	void toBinaryFile(const char filename[], VolumeCompression compression = VOLUME_COMPRESSION_NONE);
+	// writes the volume in the input file in the other format
+	static void convertFile(const char inputFilename[], const char outputFilename[], VolumeCompression compression = VOLUME_COMPRESSION_NONE);
+};
+
+// minimum and maximum of the samples of each brick of brickSize^3 cubes of a VolumetricData. a brick whose
+// samples are all below the iso threshold, or none of them, contains no surface and can be skipped as a
+// whole while marching
+template<typename T>
+class BrickSummary
+{
+private:
+	int brickSize;
+	T isoThreshold;
+	int brickCountX, brickCountY, brickCountZ;
+	std::vector<T> minimum;
+	std::vector<T> maximum;
+	int getBrickIndex(int brickX, int brickY, int brickZ);
+public:
+	const static int DEFAULT_BRICK_SIZE = 8;
+	BrickSummary(VolumetricView<T> field, int brickSize = DEFAULT_BRICK_SIZE, T isoThreshold = T());
+	int getBrickSize();
+	int getBrickCountX();
+	int getBrickCountY();
+	int getBrickCountZ();
+	T getMinimum(int brickX, int brickY, int brickZ);
+	T getMaximum(int brickX, int brickY, int brickZ);
+	bool isUniform(int brickX, int brickY, int brickZ);
+	int getUniformBrickCount();
+};
+
+// provides the samples of a volume one x slice at a time (sizeY * sizeZ values, z contiguous), in increasing x
+template<typename T>
+class VolumeSliceSource
+{
+public:
+	virtual ~VolumeSliceSource() {}
+	virtual int getSizeX() = 0;
+	virtual int getSizeY() = 0;
+	virtual int getSizeZ() = 0;
+	virtual void readSlice(int x, T slice[]) = 0;
+};
+
+// reads the slices of a binary volume file sequentially, without loading or mapping the whole file
+template<typename T>
+class BinaryVolumeSliceSource : public VolumeSliceSource<T>
+{
+private:
+	std::ifstream fin;
+	VolumeFileHeader header;
+	int nextX;
+	// the rest of the current run of an RLE-compressed file
+	uint32 runLength;
+	T runValue;
+public:
+	BinaryVolumeSliceSource(const char filename[]);
+	int getSizeX();
+	int getSizeY();
+	int getSizeZ();
+	void readSlice(int x, T slice[]);
+};
+
+// calls sliceReader(x, slice) to fill each slice, e.g. to generate the field or read it from another format
+template<typename T>
+class CallbackVolumeSliceSource : public VolumeSliceSource<T>
+{
+private:
+	int sizeX, sizeY, sizeZ;
+	std::function<void(int, T[])> sliceReader;
+public:
+	CallbackVolumeSliceSource(int sizeX, int sizeY, int sizeZ, std::function<void(int, T[])> sliceReader);
+	int getSizeX();
+	int getSizeY();
+	int getSizeZ();
+	void readSlice(int x, T slice[]);
+};
+
+// a procedural field, e.g. a signed distance function or noise, negative inside the surface. it is evaluated
+// at sample coordinates. evaluateRow fills count values along z starting at (x, y, z) and is what the sources
+// call, fields override it to share work between the samples of a row or to evaluate several at once
+class FieldFunction
+{
+public:
+	virtual ~FieldFunction() {}
+	virtual float evaluate(float x, float y, float z) = 0;
+	virtual void evaluateRow(int x, int y, int z, int count, float value[]);
+};
+
+// calls fieldFunction(x, y, z) for every sample
+class CallbackField : public FieldFunction
+{
+private:
+	std::function<float(float, float, float)> fieldFunction;
+public:
+	CallbackField(std::function<float(float, float, float)> fieldFunction);
+	float evaluate(float x, float y, float z);
+};
+
+// evaluates a field on demand, one slice or brick at a time, so it is never stored whole. the values are
+// multiplied by scale and rounded and clamped to the range of T if T is an integer type. the field is read
+// by one thread at a time
+template<typename T>
+class FieldSliceSource : public VolumeSliceSource<T>
+{
+private:
+	FieldFunction& field;
+	int sizeX, sizeY, sizeZ;
+	float scale;
+	std::vector<float> row;
+	void readRow(int x, int y, int z, int count, T samples[]);
+public:
+	FieldSliceSource(FieldFunction& field, int sizeX, int sizeY, int sizeZ, float scale = 1);
+	int getSizeX();
+	int getSizeY();
+	int getSizeZ();
+	void readSlice(int x, T slice[]);
+	// samples [x, x + brickSizeX) * [y, y + brickSizeY) * [z, z + brickSizeZ), x major like a slice. the
+	// brick may reach outside the volume, e.g. for the apron of a chunk
+	VolumetricData<T> readBrick(int x, int y, int z, int brickSizeX, int brickSizeY, int brickSizeZ);
+};
+
+// read-only volume stored as bricks of brickSize^3 samples, each one either uniform (a single value), a
+// palette of up to 16 values (or 256 for samples larger than a byte) with 1 to 8 bit indices, or raw samples.
+// the memory is mostly the bricks near the surface. every encoding is random access, so get reads a sample
+// in place and a slice or a region is decoded a brick row at a time straight into its destination. as a
+// slice source it streams into marchStream, which holds only its slice window decoded
+template<typename T>
+class CompressedVolumetricData : public VolumeSliceSource<T>
+{
+private:
+	enum BrickEncoding : uint8 { BRICK_UNIFORM, BRICK_PALETTE, BRICK_RAW };
+	struct Brick {
+		BrickEncoding encoding;
+		uint8 bitsPerIndex;
+		T value;
+		// of the palette and then the indices, or of the raw samples, in payload
+		int64 offset;
+	};
+	int sizeX, sizeY, sizeZ;
+	int brickSize;
+	int brickCountX, brickCountY, brickCountZ;
+	std::vector<Brick> brick;
+	std::vector<uint8> payload;
+	int getBrickExtent(int brickIndex, int sampleCount);
+	void compressBrickLayer(VolumetricView<T> layer, int brickX);
+	void compressBrick(int brickX, int brickY, int brickZ, const T samples[], int extentX, int extentY, int extentZ);
+	// count samples along z from the local position (x, y, z) of a brick
+	void readBrickRow(const Brick& brick, int x, int y, int z, int extentY, int extentZ, int count, T row[]);
+public:
+	const static int DEFAULT_BRICK_SIZE = 16;
+	CompressedVolumetricData(VolumetricView<T> field, int brickSize = DEFAULT_BRICK_SIZE);
+	// compresses the slices of source as they are read, holding only brickSize of them at a time
+	CompressedVolumetricData(VolumeSliceSource<T>& source, int brickSize = DEFAULT_BRICK_SIZE);
+	T get(int x, int y, int z);
+	int getSizeX();
+	int getSizeY();
+	int getSizeZ();
+	void readSlice(int x, T slice[]);
+	// the samples of [x, x + regionSizeX) * [y, y + regionSizeY) * [z, z + regionSizeZ), densely packed like a
+	// VolumetricData, e.g. for the view of a chunk
+	void readRegion(int x, int y, int z, int regionSizeX, int regionSizeY, int regionSizeZ, T region[]);
+	VolumetricData<T> decompress();
+	int getBrickSize();
+	int getBrickCountX();
+	int getBrickCountY();
+	int getBrickCountZ();
+	bool isUniform(int brickX, int brickY, int brickZ);
+	int getUniformBrickCount();
+	int getPaletteBrickCount();
+	// bytes of the bricks and their payload
+	int64 getByteCount();
+};
+
+// receives the mesh of a streamed volume in pieces. triangles refer to vertices by their index among
+// every vertex added so far
+template<typename IndexType>
+class MeshSink
+{
+public:
+	virtual ~MeshSink() {}
+	virtual void addVertices(const Vertex vertex[], int count) = 0;
+	virtual void addTriangles(const IndexedTriangle<IndexType> triangle[], int count) = 0;
+	// one normal per vertex, in the same order, only called if MarchingSettings::computeNormals is set
+	virtual void addNormals(const Vector3D /*normal*/[], int /*count*/) {}
+};
+
+// the cubes [xBegin, xEnd) x [yBegin, yEnd) x [zBegin, zEnd) of a volume
+struct CubeRange
+{
+	int xBegin, xEnd;
+	int yBegin, yEnd;
+	int zBegin, zEnd;
+	CubeRange(int xBegin = 0, int xEnd = 0, int yBegin = 0, int yEnd = 0, int zBegin = 0, int zEnd = 0);
 };
 
-class MarchedGeometry
+// what happened while marching, see MARCHING_CUBES_STATS. the seconds are summed over the threads
+struct MarchingStats
 {
+	const static int CASE_COUNT = 256;
+	// false if the library was built without MARCHING_CUBES_STATS, every count is 0 then
+	bool isEnabled;
+	// classified cubes of each case index, the cubes of skipped bricks are not classified
+	int64 caseCount[CASE_COUNT];
+	// classified cubes of case 0 or 255
+	int64 emptyCubeCount;
+	// vertices taken from the double-deck, and vertices created, on a corner or inside an edge
+	int64 reusedCornerVertexCount;
+	int64 newCornerVertexCount;
+	int64 reusedEdgeVertexCount;
+	int64 newEdgeVertexCount;
+	// triangles dropped by isTriangleAreaZero, in the cubes and when stitching slabs
+	int64 degenerateTriangleCount;
+	// building the brick summary and reading the slices of a stream
+	double loadSeconds;
+	// the counting pass that sizes the output
+	double countSeconds;
+	// classifying the rows of cubes
+	double classifySeconds;
+	// generating the vertices and triangles of active cubes, and stitching slabs
+	double emitSeconds;
+	// writing the mesh to files
+	double writeSeconds;
+	// hardware counters of the marching threads from perf_event_open, -1 where they are not available
+	int64 cycleCount;
+	int64 instructionCount;
+	int64 cacheReferenceCount;
+	int64 cacheMissCount;
+	MarchingStats();
+	void add(const MarchingStats& stats);
+	std::string toJson() const;
+	void toJsonFile(const char filename[]) const;
+};
+
+struct MarchingSettings
+{
+	// number of worker threads, each marching its own x-slab of the volume. 0 uses every hardware thread.
+	int threadCount;
+	// build a BrickSummary of the field and skip the bricks that contain no surface
+	bool skipEmptyBricks;
+	// compute a normal for every vertex from the gradient of the field, stored next to the vertices
+	bool computeNormals;
+	// the surface separates the samples below isoValue, which are inside, from the others
+	float isoValue;
+	// store the vertices as CompactVertex once marched, see MarchedGeometry::compactVertices. ignored by marchStream
+	// and LodGeometry
+	bool compactVertices;
+	MarchingSettings(int threadCount = 1);
+};
+
+class MarchingCubesTables
+{
+protected:
 	const static int MAX_TRIANGLE_PER_CUBE = 5;
 	const static int MAX_VERTEX_PER_CUBE = 12;
 	const static int CASE_COUNT = 256;
@@ -80,153 +507,1505 @@ class MarchedGeometry
 			CodeBits parts;
 		};
 	};
+	static const uint8 caseIndexToClassIndex[CASE_COUNT];
+	static const ClassGeometry classGeometry[CLASS_COUNT];
+	static const OnEdgeVertexCode onEdgeVertexCode[CASE_COUNT][MAX_VERTEX_PER_CUBE];
+	// the three tables above expanded at compile time into a single entry per case, one cache line each,
+	// so a cube reads its geometry without going through its class or decoding bitfields
+	struct alignas(64) CaseGeometry
+	{
+		uint8 triangleCount;
+		uint8 vertexCount;
+		// the cube vertices of the triangles
+		uint8 vertexIndex[MAX_TRIANGLE_PER_CUBE * 3];
+		// the lower numbered corner of the vertex edge in the low nibble, the higher numbered in the high one
+		uint8 cornerPair[MAX_VERTEX_PER_CUBE];
+		// the reuse slot of the vertex edge in this cube, and the deltas to the slot in an older cube
+		uint8 edgeIndex[MAX_VERTEX_PER_CUBE];
+		uint8 edgeDelta[MAX_VERTEX_PER_CUBE];
+	};
+	static const std::array<CaseGeometry, CASE_COUNT> caseGeometry;
+	static constexpr std::array<CaseGeometry, CASE_COUNT> buildCaseGeometry();
+	// (1 << INTERPOLATION_RECIPROCAL_SHIFT) / d rounded up for every difference d of two 8-bit samples.
+	// multiplying by it and shifting back is the exact integer division for dividends below 1 << 16
+	const static int INTERPOLATION_RECIPROCAL_SHIFT = 24;
+	alignas(64) static const std::array<uint32, 256> interpolationReciprocal;
+	static constexpr std::array<uint32, 256> buildInterpolationReciprocal();
+	// the weight of the first of two 8-bit samples out of 0x0100, from their distances to the iso-value, which
+	// have opposite signs or are 0. the same quotient as (distance1 * 0x0100) / (distance1 - distance0)
+	static int32 getByteInterpolationT(int32 distance0, int32 distance1);
+	// the transition cell of Lengyel's Transvoxel algorithm, between a face of 3x3 samples of the finer
+	// neighbor (sample 3 * j + i at (i, j)) and the face of a coarse cell with its corners at samples 9 to
+	// 12, copies of samples 0, 2, 6 and 8. the case index has a bit for each negative sample of the 9
+	const static int TRANSITION_CASE_COUNT = 512;
+	const static int TRANSITION_SAMPLE_COUNT = 13;
+	const static int TRANSITION_EDGE_COUNT = 16;
+	const static int MAX_TRIANGLE_PER_TRANSITION_CELL = 12;
+	struct TransitionCellGeometry
+	{
+		uint8 triangleCount;
+		// transition edges of the triangle vertices
+		uint8 edgeIndex[MAX_TRIANGLE_PER_TRANSITION_CELL * 3];
+	};
+	// the samples at the ends of each edge that can have a vertex, the lower coordinate first
+	static const uint8 transitionEdgeSample[TRANSITION_EDGE_COUNT][2];
+	static const TransitionCellGeometry& getTransitionCellGeometry(int caseIndex);
+	static void buildTransitionCellGeometry(int caseIndex, TransitionCellGeometry& geometry);
+	// writes the case index of the cubeCount cubes along the 4 given rows, and returns false if every
+	// one of them is empty (case 0 or 255). a corner sets its bit where its value is below isoThreshold.
+	// selected at runtime between SSE2, AVX2 and scalar code
+	template<typename SampleType>
+	using RowClassifierOf = bool (*)(const SampleType* row[4], int cubeCount, SampleType isoThreshold, uint8 caseIndex[]);
+	template<typename SampleType>
+	static bool classifyRowScalar(const SampleType* row[4], int cubeCount, SampleType isoThreshold, uint8 caseIndex[]);
+	template<typename SampleType>
+	static bool classifyRowSSE2(const SampleType* row[4], int cubeCount, SampleType isoThreshold, uint8 caseIndex[]);
+	template<typename SampleType>
+	static bool classifyRowAVX2(const SampleType* row[4], int cubeCount, SampleType isoThreshold, uint8 caseIndex[]);
+	template<typename SampleType>
+	static RowClassifierOf<SampleType> getRowClassifier();
+	// the iso-value as a sample, so that value < isoThreshold exactly when value < isoValue: rounded up for
+	// integer samples, clamped to their range. false if every possible sample is below isoValue
+	template<typename SampleType>
+	static bool getIsoThreshold(float isoValue, SampleType& isoThreshold);
+	template<typename SampleType>
+	static int64 countSignChangeEdges(VolumetricView<SampleType> field, CubeRange range, SampleType isoThreshold, BrickSummary<SampleType>* brickSummary = NULL);
+	template<typename SampleType>
+	static int64 countRowSignChangeEdges(const SampleType* row, const SampleType* nextRowX, const SampleType* nextRowY, int zBegin, int zEnd, int zLast, SampleType isoThreshold);
+	template<typename SampleType>
+	static int64 getVertexCountUpperBound(VolumetricView<SampleType> field, SampleType isoThreshold);
+};
+
+// a cluster of the triangles of a mesh, small enough for a mesh shader workgroup and to be culled as a whole
+struct Meshlet
+{
+	// the vertices of the meshlet are vertex[vertexOffset, vertexOffset + vertexCount) of its MeshletSet, and its
+	// triangles the 3 * triangleCount local indices into them from triangle[3 * triangleOffset]
+	int vertexOffset, vertexCount;
+	int triangleOffset, triangleCount;
+	// bounding sphere of the vertices
+	Vector3D center;
+	float radius;
+	// unit mean of the triangle normals. every triangle faces away from a view direction d, a unit vector from the
+	// eye towards the meshlet, if dot(d, coneAxis) > coneCutoff, which is 1 when the normals spread too much
+	Vector3D coneAxis;
+	float coneCutoff;
+};
+
+struct MeshletSet
+{
+	std::vector<Meshlet> meshlet;
+	// index in the vertex array of the geometry of each vertex of each meshlet
+	std::vector<uint32> vertex;
+	// 3 indices into the vertices of its meshlet per triangle
+	std::vector<uint8> triangle;
+};
+
+// memory kept from one meshing to the next: the double-decks and case rows of the slabs, and the vertex,
+// normal and triangle arrays of the slabs and of the mesh. a MarchedGeometry built with a context marches
+// in this memory instead of allocating its own, and its mesh stays in the context. the memory only grows,
+// so meshing a stream of chunks of the same size doesn't allocate once the first chunk is meshed, as long
+// as it is marched as a single slab without skipEmptyBricks. one geometry at a time uses a context
+class MeshingContext
+{
+private:
+	template<typename IndexType, typename SampleType> friend class MarchedGeometry;
+	// the arrays of a slab, or of the mesh. set 0 is the mesh, and the only slab when there is one
+	enum Array { DECK, CASE_ROW, VERTEX, NORMAL, TRIANGLE, ARRAY_COUNT };
+	std::vector<void*> memory;
+	std::vector<int64> capacity;
+	bool isInUse;
+	// at least byteCount bytes for array of set, its content is lost when it grows
+	void* reserve(int set, Array array, int64 byteCount);
+public:
+	MeshingContext();
+	MeshingContext(const MeshingContext&) = delete;
+	MeshingContext& operator=(const MeshingContext&) = delete;
+	~MeshingContext();
+	// bytes held by the context
+	int64 getByteCount();
+	// frees the memory, the next meshing allocates it again. throws while a geometry uses the context
+	void clear();
+};
+
+template<typename IndexType, typename SampleType> class BatchMesher;
+
+// IndexType is the type of the vertex indices in the generated triangles, uint16 or uint32.
+// uint16 keeps small meshes compact, marching a volume that generates more vertices than
+// IndexType can address throws instead of wrapping around.
+// SampleType is the type of the field, int8, uint8, int16 or float, marched as it is without conversion.
+template<typename IndexType = uint16, typename SampleType = int8>
+class MarchedGeometry : protected MarchingCubesTables
+{
+	typedef IndexedTriangle<IndexType> Triangle;
+	typedef RowClassifierOf<SampleType> RowClassifier;
+	// where a vertex lies on its edge, as the weight of the lower numbered corner out of INTERPOLATION_ONE.
+	// fixed-point with 8 fractional bits for 8-bit samples and 16 for int16, a plain fraction for floats
+	typedef typename std::conditional<std::is_floating_point<SampleType>::value, float, int32>::type InterpolationType;
+	constexpr static InterpolationType INTERPOLATION_ONE = std::is_floating_point<SampleType>::value ? 1 : (sizeof(SampleType) == 1 ? 0x0100 : 0x10000);
 	struct ReusableCubeData
 	{
 		const static int REUSABLE_EDGE_COUNT = 9;
-		const static int REUSABLE_CORNER_COUNT = 7;
-		const static uint16 BLANK = 0xFFFF;
-		uint16 corner[REUSABLE_CORNER_COUNT];
-		uint16 edge[REUSABLE_EDGE_COUNT];
-		void reset();
-		void setCorner(uint8 cornerIndex, uint16 value);
-		uint16 getCorner(uint8 cornerIndex);
-		void setEdge(uint8 edgeIndex, uint16 value);
-		uint16 getEdge(uint8 edgeIndex);
+		const static int REUSABLE_CORNER_COUNT = 8;
+		const static IndexType BLANK = (IndexType)~0;
+		// x of the cube this data was last reset for, the data is stale for any other cube
+		int cubeX;
+		IndexType corner[REUSABLE_CORNER_COUNT];
+		IndexType edge[REUSABLE_EDGE_COUNT];
+		void reset(int cubeX);
+		void setCorner(uint8 cornerIndex, IndexType value);
+		IndexType getCorner(uint8 cornerIndex);
+		void setEdge(uint8 edgeIndex, IndexType value);
+		IndexType getEdge(uint8 edgeIndex);
 	};
 	class ReusableCubeDoubleDeck {
 	private:
-		int cubeCountX, cubeCountY;
+		int yBegin, zBegin;
+		int cubeCountY, cubeCountZ;
 		ReusableCubeData* deck[2];
 	public:
-		ReusableCubeDoubleDeck(int cubeCountX, int cubeCountY);
-		ReusableCubeData& get(int deckId, int x, int y);
-		~ReusableCubeDoubleDeck();
+		// holds the cubes of two x planes of the cubeCountY * cubeCountZ cubes starting at (yBegin, zBegin), in
+		// the 2 * cubeCountY * cubeCountZ entries of memory, which the caller owns
+		ReusableCubeDoubleDeck(int yBegin, int zBegin, int cubeCountY, int cubeCountZ, ReusableCubeData memory[]);
+		// data of the cube at (x, y, z), reset on first use so empty cubes never have to touch the deck
+		ReusableCubeData& get(int x, int y, int z);
+	};
+	struct BoundaryVertex
+	{
+		int64 key;
+		int vertexIndex;
+	};
+	struct MarchingSlab
+	{
+		CubeRange range;
+		// the set of arrays of the slab in the context
+		int contextSet;
+		int vertexCount;
+		int triangleCount;
+		// index of the first vertex in the vertex array, only non-zero while streaming
+		int vertexOffset;
+		int64 vertexCapacity;
+		int64 triangleCapacity;
+		Vertex* vertex;
+		Triangle* triangle;
+		// NULL unless normals are computed
+		Vector3D* normal;
+		// vertices created on the lower and upper x planes of the slab, used to stitch neighboring slabs
+		std::vector<BoundaryVertex> lowerBoundary;
+		std::vector<BoundaryVertex> upperBoundary;
+		MarchingStats stats;
+		MarchingSlab();
 	};
 private:
 	Vector3D cubeScale;
 	Vector3D size;
-	VolumetricData<int8> field;
+	// the field being marched, only set while marching
+	VolumetricView<SampleType> field;
+	SampleType isoThreshold;
+	// true if isoThreshold is the iso-value itself, the distances of the samples to it are then integers
+	bool isIsoValueASample;
+	// x of the first slice held in field, only non-zero while streaming
+	int fieldOffsetX;
+	// the cubes being marched
+	CubeRange range;
 
 	int vertexCount;
 	int triangleCount;
 	Vertex *vertex;
 	Triangle *triangle;
+	Vector3D *normal;
+	// replaces vertex once the vertices are compacted, in the same memory
+	CompactVertex *compactVertex;
+	Vector3D compactVertexScale;
+	Vector3D compactVertexOffset;
 	int cubeCountX, cubeCountY, cubeCountZ;
+	MarchingSettings settings;
+	BrickSummary<SampleType>* brickSummary;
+	// where the arrays are taken from while marching, NULL without a context. the arrays of the mesh are only
+	// kept in the context, which then owns them, if isMeshInContext
+	MeshingContext* context;
+	bool isMeshInContext;
+	std::atomic<int64> allocatedByteCount;
+	std::atomic<int64> peakByteCount;
+	MarchingStats stats;
 
-	static const uint8 caseIndexToClassIndex[CASE_COUNT];
-	static const ClassGeometry classGeometry[CLASS_COUNT];
-	static const OnEdgeVertexCode onEdgeVertexCode[CASE_COUNT][MAX_VERTEX_PER_CUBE];
-
-	int8 getCornerFieldValue(int x, int y, int z, int cornerIndex);
-	uint32 getCaseIndex(int x, int y, int z);
+	void trackMemory(int64 byteCount);
+	// the memory of an array of a slab or of the mesh, taken from the context if there is one
+	bool isInContext(int contextSet, MeshingContext::Array array);
+	void* allocate(int64 byteCount, int contextSet, MeshingContext::Array array);
+	void* shrink(void* memory, int64 oldByteCount, int64 newByteCount, int contextSet, MeshingContext::Array array);
+	void release(void* memory, int64 byteCount, int contextSet, MeshingContext::Array array);
+	void getRows(int x, int y, const SampleType* row[4]);
+	void getCornerFieldValues(const SampleType* row[4], int z, SampleType cornerValue[CORNER_COUNT]);
+	bool classifyActiveRow(int x, int y, int zBegin, int zEnd, const SampleType* row[4], RowClassifier classifyRow, uint8 caseIndexRow[]);
 	uint32 getCornerDeltaMask(int x, int y, int z);
 	uint32 getEdgeDeltaMask(int x, int y, int z);
-	int32 getInterpolationT(int x, int y, int z, OnEdgeVertexCode code);
-	uint16 getVertexIndexOnCorner(int x, int y, int z, OnEdgeVertexCode code, int32 interpolationT, ReusableCubeDoubleDeck& deck);
-	uint16 getNewVertexIndexOnCorner(int x, int y, int z, uint8 cornerIndex);
-	uint16 getVertexIndexOnEdge(int x, int y, int z, OnEdgeVertexCode code, int32 interpolationT, ReusableCubeDoubleDeck& deck);
-	uint16 getNewVertexIndexOnEdge(int x, int y, int z, OnEdgeVertexCode code, int32 interpolationT);
-	bool isTriangleAreaZero(int triangleIndex);
-	void setVertex(uint16 vertexIndex, float xPos, float yPos, float zPos);
+	InterpolationType getInterpolationT(SampleType fieldValue0, SampleType fieldValue1);
+	int64 getBoundaryKey(int y, int z, int kind);
+	void recordBoundaryVertex(MarchingSlab& slab, int x, int y, int z, int kind, IndexType vertexIndex);
+	IndexType getVertexIndexOnCorner(int x, int y, int z, uint8 cornerIndex, uint32 cornerDeltaMask, ReusableCubeDoubleDeck& deck, MarchingSlab& slab);
+	IndexType getNewVertexIndexOnCorner(int x, int y, int z, uint8 cornerIndex, MarchingSlab& slab);
+	IndexType getVertexIndexOnEdge(int x, int y, int z, uint8 cornerPair, uint8 edgeIndex, uint32 maskedEdgeDelta, InterpolationType interpolationT, ReusableCubeDoubleDeck& deck, MarchingSlab& slab);
+	IndexType getNewVertexIndexOnEdge(int x, int y, int z, uint8 cornerPair, InterpolationType interpolationT, MarchingSlab& slab);
+	IndexType getNextVertexIndex(MarchingSlab& slab);
+	bool isTriangleAreaZero(const Triangle& triangle);
+	void setVertex(Vertex& vertex, float xPos, float yPos, float zPos);
+	Vector3D getPosition(int vertexIndex);
+	Vector3D getGradient(int x, int y, int z);
+	void setNormal(Vector3D& normal, float xGradient, float yGradient, float zGradient);
+	int getSlabCount();
 	void marchCubes();
-	void marchCube(int x, int y, int z, ReusableCubeDoubleDeck& deck);
+	void initialize(Vector3D cubeScale, int sizeX, int sizeY, int sizeZ, CubeRange range, MarchingSettings settings);
+	void marchField(VolumetricView<SampleType> field);
+	void moveFrom(MarchedGeometry& geometry);
+	void releaseMesh();
+	int64 countTriangles(CubeRange range, uint8 caseIndexRow[]);
+	void marchPlane(int x, RowClassifier classifyRow, uint8 caseIndexRow[], ReusableCubeDoubleDeck& deck, MarchingSlab& slab);
+	void marchSlab(MarchingSlab& slab);
+	void releaseSlab(MarchingSlab& slab);
+	MarchedGeometry(Vector3D cubeScale, VolumeSliceSource<SampleType>& source, MarchingSettings settings);
+	void marchSlices(VolumeSliceSource<SampleType>& source, MeshSink<IndexType>& sink);
+	void marchCube(int x, int y, int z, uint32 caseIndex, const SampleType* row[4], ReusableCubeDoubleDeck& deck, MarchingSlab& slab);
+	void stitchSlabs(MarchingSlab slabs[], int slabCount);
+	MarchedGeometry(Vector3D cubeScale, VolumetricView<SampleType> field, CubeRange range, MarchingSettings settings, MeshingContext& context, bool isMeshInContext);
+	void translate(Vector3D offset);
+	// empty mesh, initialized by its creator
+	MarchedGeometry();
+	static void marchLevelSlab(MarchedGeometry* level[], MarchingSlab* slab[], int levelCount);
+	friend class BatchMesher<IndexType, SampleType>;
 public:
-	MarchedGeometry(Vector3D cubeScale, VolumetricData<int8>);
+	// largest vertex count a mesh with this IndexType can hold
+	const static int64 MAX_VERTEX_COUNT = (int64)(IndexType)~0 < 0x7FFFFFFF ? (int64)(IndexType)~0 : 0x7FFFFFFF;
+	// the field is only read while marching, a VolumetricData converts to a view of itself without a copy
+	MarchedGeometry(Vector3D cubeScale, VolumetricView<SampleType> field, MarchingSettings settings = MarchingSettings());
+	// marches only the cubes in range, the vertices are still placed by their position in the whole field
+	MarchedGeometry(Vector3D cubeScale, VolumetricView<SampleType> field, CubeRange range, MarchingSettings settings = MarchingSettings());
+	// marches in the memory of context, which holds the mesh until this geometry is destroyed. throws if
+	// another geometry still uses context
+	MarchedGeometry(Vector3D cubeScale, VolumetricView<SampleType> field, MarchingSettings settings, MeshingContext& context);
+	MarchedGeometry(Vector3D cubeScale, VolumetricView<SampleType> field, CubeRange range, MarchingSettings settings, MeshingContext& context);
+	MarchedGeometry(const MarchedGeometry&) = delete;
+	MarchedGeometry& operator=(const MarchedGeometry&) = delete;
+	// takes the mesh of geometry, which is left empty
+	MarchedGeometry(MarchedGeometry&& geometry);
+	MarchedGeometry& operator=(MarchedGeometry&& geometry);
 	~MarchedGeometry();
+	// true if marching this field can never generate more vertices than IndexType can address
+	static bool canIndex(VolumetricView<SampleType> field, float isoValue = 0);
+	// bytes held by the vertex and triangle arrays of the generated mesh
+	int64 getByteCount();
+	// the most bytes held at once while marching, including the per-thread output and reusable data
+	int64 getPeakByteCount();
+	// number of bricks skipped as empty, 0 unless MarchingSettings::skipEmptyBricks is set
+	int getSkippedBrickCount();
+	// counters and timers of the marching and of the writes so far
+	const MarchingStats& getStats();
+	// marches a volume read slice by slice from source and hands the mesh to sink plane by plane, so
+	// only two slices (four with normals) and the output of one plane are in memory. threadCount and
+	// skipEmptyBricks are ignored. returns the peak byte count, and fills stats if it isn't NULL
+	static int64 marchStream(Vector3D cubeScale, VolumeSliceSource<SampleType>& source, MeshSink<IndexType>& sink, MarchingSettings settings = MarchingSettings(), MarchingStats* stats = NULL);
+	// marches the surface of every iso-value in one pass over the field, one mesh per iso-value in the same order.
+	// each row of samples is read once and classified against every level, which marches its cubes in its own
+	// case row, double-deck and output. settings.isoValue and skipEmptyBricks are ignored
+	static std::vector<MarchedGeometry> marchLevels(Vector3D cubeScale, VolumetricView<SampleType> field, const std::vector<float>& isoValues, MarchingSettings settings = MarchingSettings());
+	int getVertexCount();
+	int getTriangleCount();
+	// NULL once the vertices are compacted
+	const Vertex* getVertices();
+	// stores the positions as lattice coordinates relative to the lowest cube of the mesh, in 16-bit fixed point
+	// with 8 fractional bits, or fewer along an axis the mesh spans more than 255 cubes of. that is the grid
+	// 8-bit samples place the vertices on, so their positions are kept exactly, and rounded to it for the other
+	// sample types. halves the memory of the vertices, which is reused in place. the writers write the
+	// compact positions to PLY and raw files, with the scale and offset in comments of the PLY header
+	void compactVertices();
+	// NULL unless the vertices are compacted
+	const CompactVertex* getCompactVertices();
+	// a compact vertex is at getCompactVertexOffset() + position * getCompactVertexScale() along each axis
+	Vector3D getCompactVertexScale();
+	Vector3D getCompactVertexOffset();
+	const IndexedTriangle<IndexType>* getTriangles();
+	// one normal per vertex, NULL unless MarchingSettings::computeNormals is set
+	const Vector3D* getNormals();
 	void toFile(const char filename[]);
+	// binary little-endian PLY
+	void toPlyFile(const char filename[]);
+	void toObjFile(const char filename[]);
+	// raw buffers ready to upload to a GPU: 3 floats (3 uint16 once compacted) per vertex, 3 floats per normal, and
+	// 3 IndexType per triangle
+	void toRawFiles(const char vertexFilename[], const char indexFilename[], const char normalFilename[] = NULL);
+	const static int DEFAULT_VERTEX_CACHE_SIZE = 16;
+	// reorders the triangles so the ones sharing vertices are drawn close together, for the post-transform vertex
+	// cache of a GPU holding cacheSize vertices (Tipsify). the triangles are in cube order otherwise
+	void optimizeVertexCache(int cacheSize = DEFAULT_VERTEX_CACHE_SIZE);
+	// renumbers the vertices and their normals in the order the triangles first use them, so the vertex fetches
+	// follow the index buffer. the vertices no triangle uses go last
+	void reorderVertices();
+	// splits the triangles, in their current order, into meshlets of at most maxVertexCount vertices (up to 256)
+	// and maxTriangleCount triangles. the meshlets are tighter after optimizeVertexCache
+	MeshletSet buildMeshlets(int maxVertexCount = 64, int maxTriangleCount = 124);
+};
+
+// meshes batches of independent chunks on a pool of worker threads, each marching with its own
+// MeshingContext. a chunk view holds the samples of its cubes and an apron of one sample on every side, so a
+// view of sizeX * sizeY * sizeZ samples has (sizeX - 3) * (sizeY - 3) * (sizeZ - 3) cubes starting at
+// (1, 1, 1). neighbor chunks share the samples of their common face, so their meshes join without cracks,
+// and the apron gives the vertices on that face the same normals in both chunks. the vertices are placed
+// from the first cube of the chunk. the chunks are dealt to the workers in blocks, and a worker that runs
+// out of chunks steals half of the chunks left to another. MarchingSettings::threadCount is ignored
+template<typename IndexType = uint16, typename SampleType = int8>
+class BatchMesher
+{
+public:
+	// called by the worker that meshed the chunk, with a mesh that is only valid during the call
+	typedef std::function<void(int chunkIndex, MarchedGeometry<IndexType, SampleType>& geometry)> Callback;
+private:
+	struct Worker
+	{
+		std::thread thread;
+		MeshingContext context;
+		// the chunks [chunkBegin, chunkEnd) left to this worker, the worker takes them from the front and the
+		// other workers steal them from the back
+		std::mutex chunkMutex;
+		int chunkBegin, chunkEnd;
+	};
+	std::vector<Worker*> worker;
+	// one batch at a time
+	std::mutex batchMutex;
+	std::mutex mutex;
+	std::condition_variable batchStarted;
+	std::condition_variable batchFinished;
+	// number of batches started, a worker waits for the next one when it is done with a batch
+	int64 batchIndex;
+	int runningWorkerCount;
+	bool isStopping;
+	// the batch being meshed, into result if it isn't NULL and through callback otherwise
+	Vector3D cubeScale;
+	const std::vector<VolumetricView<SampleType>>* chunks;
+	MarchingSettings settings;
+	MarchedGeometry<IndexType, SampleType>** result;
+	const Callback* callback;
+	std::atomic<bool> hasError;
+	std::exception_ptr error;
+	void runWorker(int workerIndex);
+	bool takeChunk(int workerIndex, int& chunkIndex);
+	void marchChunk(Worker& worker, int chunkIndex);
+	void marchBatch();
+public:
+	// threadCount workers, 0 for every hardware thread
+	BatchMesher(int threadCount = 0);
+	BatchMesher(const BatchMesher&) = delete;
+	BatchMesher& operator=(const BatchMesher&) = delete;
+	~BatchMesher();
+	int getThreadCount();
+	// the meshes of chunks in the same order
+	std::vector<MarchedGeometry<IndexType, SampleType>> march(Vector3D cubeScale, const std::vector<VolumetricView<SampleType>>& chunks, MarchingSettings settings = MarchingSettings());
+	// hands each mesh to callback as soon as it is meshed. the meshes stay in the memory of the workers,
+	// so meshing batch after batch of chunks of the same size doesn't allocate. returns after every callback
+	void march(Vector3D cubeScale, const std::vector<VolumetricView<SampleType>>& chunks, Callback callback, MarchingSettings settings = MarchingSettings());
+};
+
+// mesh of a volume kept as one MarchedGeometry piece per brick of VolumetricData::DIRTY_BRICK_SIZE^3 cubes, so
+// after editing the volume only the pieces of its dirty bricks are marched again. the vertices on the faces
+// between bricks are repeated in the pieces of both bricks
+template<typename IndexType = uint16>
+class BrickedGeometry
+{
+private:
+	Vector3D cubeScale;
+	MarchingSettings settings;
+	int cubeCountX, cubeCountY, cubeCountZ;
+	int brickCountX, brickCountY, brickCountZ;
+	std::vector<MarchedGeometry<IndexType>*> piece;
+	void marchBrick(VolumetricData<int8>& field, int brickIndex);
+	void releasePieces();
+public:
+	const static int BRICK_SIZE = VolumetricData<int8>::DIRTY_BRICK_SIZE;
+	// also clears the dirty bricks of field, the pieces are up to date with it
+	BrickedGeometry(Vector3D cubeScale, VolumetricData<int8>& field, MarchingSettings settings = MarchingSettings());
+	BrickedGeometry(const BrickedGeometry&) = delete;
+	BrickedGeometry& operator=(const BrickedGeometry&) = delete;
+	BrickedGeometry(BrickedGeometry&& geometry);
+	BrickedGeometry& operator=(BrickedGeometry&& geometry);
+	~BrickedGeometry();
+	// marches the dirty bricks of field again and clears them, returns the number of remeshed bricks
+	int remesh(VolumetricData<int8>& field);
+	int getBrickCountX();
+	int getBrickCountY();
+	int getBrickCountZ();
+	// mesh of the cubes of the brick, NULL if the brick has no surface
+	MarchedGeometry<IndexType>* getPiece(int brickX, int brickY, int brickZ);
+	int getVertexCount();
+	int getTriangleCount();
+};
+
+// faces of a LodGeometry chunk whose neighbor chunk is marched at half its stride
+enum TransitionFace {
+	TRANSITION_NEGATIVE_X = 1,
+	TRANSITION_POSITIVE_X = 2,
+	TRANSITION_NEGATIVE_Y = 4,
+	TRANSITION_POSITIVE_Y = 8,
+	TRANSITION_NEGATIVE_Z = 16,
+	TRANSITION_POSITIVE_Z = 32
+};
+
+// mesh of a chunk marched every 2^lod samples, for the chunks of a large volume that are far away. the
+// size of the field minus one must be a multiple of the stride on every axis. along the transitionFaces
+// the outer layer of cells is shrunk to 1 - transitionWidth of a cell, and the gap is filled with the
+// transition cells of Lengyel's Transvoxel algorithm that join the surface of the finer neighbor without
+// cracks. the vertices of the transition cells are not shared with each other or with the regular cells.
+// only int8 fields marched at the iso-value 0 are supported, and lod must be in [0, 16]
+template<typename IndexType = uint16>
+class LodGeometry : protected MarchingCubesTables
+{
+private:
+	int lod;
+	int transitionTriangleCount;
+	std::vector<Vertex> vertex;
+	std::vector<IndexedTriangle<IndexType>> triangle;
+	void shrinkBoundaryCells(Vector3D cubeScale, VolumetricView<int8> field, int transitionFaces, float transitionWidth);
+	void marchTransitionFace(Vector3D cubeScale, VolumetricView<int8> field, int face, float transitionWidth);
+	IndexType addVertex(const float position[3]);
+public:
+	LodGeometry(Vector3D cubeScale, VolumetricView<int8> field, int lod, int transitionFaces = 0, float transitionWidth = 0.5f, MarchingSettings settings = MarchingSettings());
+	int getLod();
+	int getStride();
+	int getVertexCount();
+	int getTriangleCount();
+	// the transition triangles are the last ones
+	int getTransitionTriangleCount();
+	const Vertex* getVertices();
+	const IndexedTriangle<IndexType>* getTriangles();
 };
 
 // The following function are not in MarchingCubes.cpp due to linker errors.
 // for more information refer to https://isocpp.org/wiki/faq/templates#separate-template-fn-defn-from-decla
 
 template<typename T>
-VolumetricData<T>::VolumetricData(int _sizeX, int _sizeY, int _sizeZ, T _data[]) {
+VolumetricView<T>::VolumetricView() {
+	data = NULL;
+	sizeX = 0;
+	sizeY = 0;
+	sizeZ = 0;
+	strideX = 0;
+	strideY = 0;
+}
+
+template<typename T>
+VolumetricView<T>::VolumetricView(const T _data[], int _sizeX, int _sizeY, int _sizeZ) : VolumetricView(_data, _sizeX, _sizeY, _sizeZ, (int64)_sizeY * _sizeZ, _sizeZ) {
+}
+
+template<typename T>
+VolumetricView<T>::VolumetricView(const T _data[], int _sizeX, int _sizeY, int _sizeZ, int64 _strideX, int64 _strideY) {
+	if (_sizeX < 0 || _sizeY < 0 || _sizeZ < 0) {
+		throw std::runtime_error("Invalid dimentions in VolumetricView");
+	}
+	if (_strideY < _sizeZ || _strideX < _strideY * _sizeY) {
+		throw std::runtime_error("Rows overlap in VolumetricView");
+	}
+	data = _data;
 	sizeX = _sizeX;
 	sizeY = _sizeY;
 	sizeZ = _sizeZ;
-	data = (T*) malloc(sizeX * sizeY * sizeZ * sizeof(T));
-	for (int i = 0; i < sizeX*sizeY*sizeZ; i++) {
-		data[i] = _data[i];
-	}
+	strideX = _strideX;
+	strideY = _strideY;
 }
 
 template<typename T>
-VolumetricData<T>::VolumetricData(const VolumetricData<T>& volumetricData) {
-	sizeX = volumetricData.sizeX;
-	sizeY = volumetricData.sizeY;
-	sizeZ = volumetricData.sizeZ;
-	data = (T*)malloc(sizeX * sizeY * sizeZ * sizeof(T));
-	for (int i = 0; i < sizeX * sizeY * sizeZ; i++) {
-		data[i] = volumetricData.data[i];
-	}
+VolumetricView<T>::VolumetricView(const VolumetricData<T>& volumetricData) {
+	*this = volumetricData.getView();
 }
 
 template<typename T>
-T VolumetricData<T>::get(int x, int y, int z) {
+T VolumetricView<T>::get(int x, int y, int z) const {
 	if (x < 0 || x >= sizeX) {
-		throw std::runtime_error("X dimention out of bound in VolumetricData get function");
+		throw std::runtime_error("X dimention out of bound in VolumetricView get function");
 	}
 	if (y < 0 || y >= sizeY) {
-		throw std::runtime_error("Y dimention out of bound in VolumetricData get function");
+		throw std::runtime_error("Y dimention out of bound in VolumetricView get function");
 	}
 	if (z < 0 || z >= sizeZ) {
-		throw std::runtime_error("Z dimention out of bound in VolumetricData get function");
+		throw std::runtime_error("Z dimention out of bound in VolumetricView get function");
 	}
-	return data[x * sizeY * sizeZ + y * sizeZ + z];
+	return data[x * strideX + y * strideY + z];
 }
 
 template<typename T>
-VolumetricData<T>::~VolumetricData() {
-	free(data);
+T VolumetricView<T>::getUnchecked(int x, int y, int z) const {
+#ifdef MARCHING_CUBES_VALIDATE
+	return get(x, y, z);
+#else
+	return data[x * strideX + y * strideY + z];
+#endif
 }
 
 template<typename T>
-int VolumetricData<T>::getSizeX() {
+const T* VolumetricView<T>::getRow(int x, int y) const {
+#ifdef MARCHING_CUBES_VALIDATE
+	if (x < 0 || x >= sizeX) {
+		throw std::runtime_error("X dimention out of bound in VolumetricView getRow function");
+	}
+	if (y < 0 || y >= sizeY) {
+		throw std::runtime_error("Y dimention out of bound in VolumetricView getRow function");
+	}
+#endif
+	return data + x * strideX + y * strideY;
+}
+
+template<typename T>
+int VolumetricView<T>::getSizeX() const {
 	return sizeX;
 }
 
 template<typename T>
-int VolumetricData<T>::getSizeY() {
+int VolumetricView<T>::getSizeY() const {
 	return sizeY;
 }
 
 template<typename T>
-int VolumetricData<T>::getSizeZ() {
+int VolumetricView<T>::getSizeZ() const {
 	return sizeZ;
 }
 
 template<typename T>
-VolumetricData<T> VolumetricData<T>::fromFile(const char filename[]) {
-	std::ifstream fin(filename);
-	if (!fin.is_open()) {
-;		throw std::runtime_error("Can't open file");
+int64 VolumetricView<T>::getStrideX() const {
+	return strideX;
+}
+
+template<typename T>
+int64 VolumetricView<T>::getStrideY() const {
+	return strideY;
+}
+
+template<typename T>
+VolumetricView<T> VolumetricView<T>::getSubView(int x, int y, int z, int _sizeX, int _sizeY, int _sizeZ) const {
+	if (x < 0 || _sizeX < 0 || x + _sizeX > sizeX || y < 0 || _sizeY < 0 || y + _sizeY > sizeY || z < 0 || _sizeZ < 0 || z + _sizeZ > sizeZ) {
+		throw std::runtime_error("Sub-view out of bound in VolumetricView");
 	}
-	int sizeX, sizeY, sizeZ;
-	fin >> sizeX >> sizeY >> sizeZ;
-	T* data = (T*)malloc(sizeX*sizeY*sizeZ*sizeof(T));
-	for (int i = 0; i < sizeX * sizeY * sizeZ; i++) {
-		int value;
-		fin >> value;
-		data[i] = (T)value; // TODO proper casting
+	return VolumetricView<T>(data + x * strideX + y * strideY + z, _sizeX, _sizeY, _sizeZ, strideX, strideY);
+}
+
+template<typename T>
+VolumetricData<T>::VolumetricData(int _sizeX, int _sizeY, int _sizeZ, T _data[]) {
+	sizeX = _sizeX;
+	sizeY = _sizeY;
+	sizeZ = _sizeZ;
+	mappedFile = NULL;
+	data = (T*) malloc((int64)sizeX * sizeY * sizeZ * sizeof(T));
+	for (int64 i = 0; i < (int64)sizeX * sizeY * sizeZ; i++) {
+		data[i] = _data[i];
 	}
-	fin.close();
-	auto ret = VolumetricData<T>(sizeX, sizeY, sizeZ, data);
-	free(data);
-	return ret;
 }
 
 template<typename T>
-void VolumetricData<T>::toFile(const char filename[]) {
-	std::ofstream fout(filename);
-	if (!fout.is_open()) {
-		throw std::runtime_error("Can't open file");
+VolumetricData<T>::VolumetricData(int _sizeX, int _sizeY, int _sizeZ, T _data[], MappedFile* _mappedFile) {
+	sizeX = _sizeX;
+	sizeY = _sizeY;
+	sizeZ = _sizeZ;
+	data = _data;
+	mappedFile = _mappedFile;
+}
+
+template<typename T>
+VolumetricData<T>::VolumetricData(int _sizeX, int _sizeY, int _sizeZ) {
+	sizeX = _sizeX;
+	sizeY = _sizeY;
+	sizeZ = _sizeZ;
+	mappedFile = NULL;
+	data = (T*)calloc((int64)sizeX * sizeY * sizeZ, sizeof(T));
+	if (data == NULL && (int64)sizeX * sizeY * sizeZ > 0) {
+		throw std::runtime_error("Can't allocate memory for VolumetricData");
 	}
-	fout << sizeX << " " << sizeY << " " << sizeZ << std::endl;
-	for (int i = 0; i < sizeX * sizeY * sizeZ; i++) {
-		if (i > 0) {
-			fout << " ";
+}
+
+template<typename T>
+VolumetricData<T>::VolumetricData(const VolumetricData<T>& volumetricData) {
+	sizeX = volumetricData.sizeX;
+	sizeY = volumetricData.sizeY;
+	sizeZ = volumetricData.sizeZ;
+	mappedFile = NULL;
+	int64 sampleCount = (int64)sizeX * sizeY * sizeZ;
+	data = (T*)malloc(sampleCount * sizeof(T));
+	if (data == NULL && sampleCount > 0) {
+		throw std::runtime_error("Can't allocate memory for VolumetricData");
+	}
+	if (sampleCount > 0) {
+		memcpy(data, volumetricData.data, sampleCount * sizeof(T));
+	}
+}
+
+template<typename T>
+VolumetricData<T>::VolumetricData(VolumetricData<T>&& volumetricData) {
+	data = NULL;
+	mappedFile = NULL;
+	*this = std::move(volumetricData);
+}
+
+template<typename T>
+VolumetricData<T>& VolumetricData<T>::operator=(const VolumetricData<T>& volumetricData) {
+	if (this != &volumetricData) {
+		*this = VolumetricData<T>(volumetricData);
+	}
+	return *this;
+}
+
+template<typename T>
+VolumetricData<T>& VolumetricData<T>::operator=(VolumetricData<T>&& volumetricData) {
+	if (this != &volumetricData) {
+		if (mappedFile != NULL) {
+			delete mappedFile;
 		}
-		fout << (int)data[i];
+		else {
+			free(data);
+		}
+		sizeX = volumetricData.sizeX;
+		sizeY = volumetricData.sizeY;
+		sizeZ = volumetricData.sizeZ;
+		data = volumetricData.data;
+		mappedFile = volumetricData.mappedFile;
+		dirtyBrickFlag = std::move(volumetricData.dirtyBrickFlag);
+		dirtyBrick = std::move(volumetricData.dirtyBrick);
+		volumetricData.sizeX = 0;
+		volumetricData.sizeY = 0;
+		volumetricData.sizeZ = 0;
+		volumetricData.data = NULL;
+		volumetricData.mappedFile = NULL;
+		volumetricData.dirtyBrickFlag.clear();
+		volumetricData.dirtyBrick.clear();
 	}
-	fout.close();
-}
\ No newline at end of file
+	return *this;
+}
+
+template<typename T>
+T VolumetricData<T>::get(int x, int y, int z) {
+	if (x < 0 || x >= sizeX) {
+		throw std::runtime_error("X dimention out of bound in VolumetricData get function");
+	}
+	if (y < 0 || y >= sizeY) {
+		throw std::runtime_error("Y dimention out of bound in VolumetricData get function");
+	}
+	if (z < 0 || z >= sizeZ) {
+		throw std::runtime_error("Z dimention out of bound in VolumetricData get function");
+	}
+	return data[((int64)x * sizeY + y) * sizeZ + z];
+}
+
+template<typename T>
+T VolumetricData<T>::getUnchecked(int x, int y, int z) {
+#ifdef MARCHING_CUBES_VALIDATE
+	return get(x, y, z);
+#else
+	return data[((int64)x * sizeY + y) * sizeZ + z];
+#endif
+}
+
+template<typename T>
+const T* VolumetricData<T>::getRow(int x, int y) {
+#ifdef MARCHING_CUBES_VALIDATE
+	if (x < 0 || x >= sizeX) {
+		throw std::runtime_error("X dimention out of bound in VolumetricData getRow function");
+	}
+	if (y < 0 || y >= sizeY) {
+		throw std::runtime_error("Y dimention out of bound in VolumetricData getRow function");
+	}
+#endif
+	return data + ((int64)x * sizeY + y) * sizeZ;
+}
+
+template<typename T>
+const T* VolumetricData<T>::getSlice(int x) {
+#ifdef MARCHING_CUBES_VALIDATE
+	if (x < 0 || x >= sizeX) {
+		throw std::runtime_error("X dimention out of bound in VolumetricData getSlice function");
+	}
+#endif
+	return data + (int64)x * sizeY * sizeZ;
+}
+
+template<typename T>
+T* VolumetricData<T>::getWritableSlice(int x) {
+#ifdef MARCHING_CUBES_VALIDATE
+	if (x < 0 || x >= sizeX) {
+		throw std::runtime_error("X dimention out of bound in VolumetricData getWritableSlice function");
+	}
+#endif
+	return data + (int64)x * sizeY * sizeZ;
+}
+
+template<typename T>
+VolumetricView<T> VolumetricData<T>::getView() const {
+	return VolumetricView<T>(data, sizeX, sizeY, sizeZ);
+}
+
+template<typename T>
+int VolumetricData<T>::getBrickCount(int sampleCount) {
+	return (sampleCount > 1) ? (sampleCount - 1 + DIRTY_BRICK_SIZE - 1) / DIRTY_BRICK_SIZE : 0;
+}
+
+template<typename T>
+void VolumetricData<T>::set(int x, int y, int z, T value) {
+	if (x < 0 || x >= sizeX) {
+		throw std::runtime_error("X dimention out of bound in VolumetricData set function");
+	}
+	if (y < 0 || y >= sizeY) {
+		throw std::runtime_error("Y dimention out of bound in VolumetricData set function");
+	}
+	if (z < 0 || z >= sizeZ) {
+		throw std::runtime_error("Z dimention out of bound in VolumetricData set function");
+	}
+	data[((int64)x * sizeY + y) * sizeZ + z] = value;
+	int brickCountX = getBrickCount(sizeX), brickCountY = getBrickCount(sizeY), brickCountZ = getBrickCount(sizeZ);
+	if (brickCountX == 0 || brickCountY == 0 || brickCountZ == 0) {
+		return;
+	}
+	if (dirtyBrickFlag.empty()) {
+		dirtyBrickFlag.assign((size_t)brickCountX * brickCountY * brickCountZ, 0);
+	}
+	// cubes x - 1 and x have the sample as a corner, and the gradients at the corners of cubes x - 2 and
+	// x + 1 use it
+	for (int i = std::max(x - 2, 0) / DIRTY_BRICK_SIZE; i <= std::min(x + 1, sizeX - 2) / DIRTY_BRICK_SIZE; i++) {
+		for (int j = std::max(y - 2, 0) / DIRTY_BRICK_SIZE; j <= std::min(y + 1, sizeY - 2) / DIRTY_BRICK_SIZE; j++) {
+			for (int k = std::max(z - 2, 0) / DIRTY_BRICK_SIZE; k <= std::min(z + 1, sizeZ - 2) / DIRTY_BRICK_SIZE; k++) {
+				int brickIndex = (i * brickCountY + j) * brickCountZ + k;
+				if (!dirtyBrickFlag[brickIndex]) {
+					dirtyBrickFlag[brickIndex] = 1;
+					dirtyBrick.push_back(brickIndex);
+				}
+			}
+		}
+	}
+}
+
+template<typename T>
+bool VolumetricData<T>::isBrickDirty(int brickX, int brickY, int brickZ) {
+	if (dirtyBrickFlag.empty()) {
+		return false;
+	}
+	return dirtyBrickFlag[(brickX * getBrickCount(sizeY) + brickY) * getBrickCount(sizeZ) + brickZ] != 0;
+}
+
+template<typename T>
+const std::vector<int>& VolumetricData<T>::getDirtyBricks() {
+	return dirtyBrick;
+}
+
+template<typename T>
+void VolumetricData<T>::clearDirtyBricks() {
+	for (size_t i = 0; i < dirtyBrick.size(); i++) {
+		dirtyBrickFlag[dirtyBrick[i]] = 0;
+	}
+	dirtyBrick.clear();
+}
+
+template<typename T>
+VolumetricData<T>::~VolumetricData() {
+	if (mappedFile != NULL) {
+		delete mappedFile;
+	}
+	else {
+		free(data);
+	}
+}
+
+template<typename T>
+int VolumetricData<T>::getSizeX() {
+	return sizeX;
+}
+
+template<typename T>
+int VolumetricData<T>::getSizeY() {
+	return sizeY;
+}
+
+template<typename T>
+int VolumetricData<T>::getSizeZ() {
+	return sizeZ;
+}
+
+template<typename T>
+VolumetricData<T> VolumetricData<T>::fromFile(const char filename[]) {
+	if (isBinaryVolumeFile(filename)) {
+		return fromBinaryFile(filename);
+	}
+	return fromTextFile(filename);
+}
+
+template<typename T>
+VolumetricData<T> VolumetricData<T>::fromTextFile(const char filename[]) {
+	std::ifstream fin(filename, std::ios::binary);
+	if (!fin.is_open()) {
+		throw std::runtime_error("Can't open file");
+	}
+	// parsing the whole file at once is much faster than reading the values one by one from the stream
+	std::vector<char> text((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+	fin.close();
+	text.push_back('\0');
+	char* position = text.data();
+	char* next;
+	int size[3];
+	for (int i = 0; i < 3; i++) {
+		size[i] = (int)strtol(position, &next, 10);
+		if (next == position || size[i] <= 0) {
+			throw std::runtime_error("Invalid dimentions in VolumetricData text file");
+		}
+		position = next;
+	}
+	int64 sampleCount = (int64)size[0] * size[1] * size[2];
+	T* data = (T*)malloc(sampleCount * sizeof(T));
+	if (data == NULL) {
+		throw std::runtime_error("Can't allocate memory for VolumetricData");
+	}
+	for (int64 i = 0; i < sampleCount; i++) {
+		long value = strtol(position, &next, 10);
+		if (next == position) {
+			free(data);
+			throw std::runtime_error("Not enough values in VolumetricData text file");
+		}
+		position = next;
+		if ((double)value < (double)std::numeric_limits<T>::lowest() || (double)value > (double)std::numeric_limits<T>::max()) {
+			free(data);
+			throw std::runtime_error("Value out of the range of the sample type in VolumetricData text file");
+		}
+		data[i] = (T)value;
+	}
+	return VolumetricData<T>(size[0], size[1], size[2], data, NULL);
+}
+
+template<typename T>
+VolumetricData<T> VolumetricData<T>::fromBinaryFile(const char filename[]) {
+	MappedFile* mappedFile = new MappedFile(filename);
+	T* data = NULL;
+	try {
+		VolumeFileHeader header;
+		if (mappedFile->getByteCount() < (int64)sizeof(VolumeFileHeader)) {
+			throw std::runtime_error("VolumetricData binary file is too small");
+		}
+		memcpy(&header, mappedFile->getData(), sizeof(VolumeFileHeader));
+		header.validate(VolumeSampleTypeOf<T>::value, mappedFile->getByteCount(), sizeof(T));
+		int64 sampleCount = (int64)header.sizeX * header.sizeY * header.sizeZ;
+		uint8* source = mappedFile->getData() + header.dataOffset;
+		if (header.compression == VOLUME_COMPRESSION_NONE && header.layout == VOLUME_LAYOUT_XYZ) {
+			// the samples are used right from the mapping
+			return VolumetricData<T>(header.sizeX, header.sizeY, header.sizeZ, (T*)source, mappedFile);
+		}
+		data = (T*)malloc(sampleCount * sizeof(T));
+		if (data == NULL) {
+			throw std::runtime_error("Can't allocate memory for VolumetricData");
+		}
+		if (header.compression == VOLUME_COMPRESSION_NONE) {
+			memcpy(data, source, sampleCount * sizeof(T));
+		}
+		else {
+			const int64 runByteCount = sizeof(uint32) + sizeof(T);
+			int64 i = 0;
+			for (uint64 offset = 0; offset + runByteCount <= header.dataByteCount; offset += runByteCount) {
+				uint32 runLength;
+				T value;
+				memcpy(&runLength, source + offset, sizeof(uint32));
+				memcpy(&value, source + offset + sizeof(uint32), sizeof(T));
+				if (runLength > sampleCount - i) {
+					throw std::runtime_error("Invalid run in VolumetricData binary file");
+				}
+				std::fill(data + i, data + i + runLength, value);
+				i += runLength;
+			}
+			if (i != sampleCount) {
+				throw std::runtime_error("VolumetricData binary file is truncated");
+			}
+		}
+		if (header.layout == VOLUME_LAYOUT_ZYX) {
+			T* transposed = (T*)malloc(sampleCount * sizeof(T));
+			if (transposed == NULL) {
+				throw std::runtime_error("Can't allocate memory for VolumetricData");
+			}
+			for (int z = 0; z < header.sizeZ; z++) {
+				for (int y = 0; y < header.sizeY; y++) {
+					for (int x = 0; x < header.sizeX; x++) {
+						transposed[((int64)x * header.sizeY + y) * header.sizeZ + z] = data[((int64)z * header.sizeY + y) * header.sizeX + x];
+					}
+				}
+			}
+			free(data);
+			data = transposed;
+		}
+		delete mappedFile;
+		return VolumetricData<T>(header.sizeX, header.sizeY, header.sizeZ, data, NULL);
+	}
+	catch (...) {
+		free(data);
+		delete mappedFile;
+		throw;
+	}
+}
+
+template<typename T>
+void VolumetricData<T>::toFile(const char filename[]) {
+	std::ofstream fout(filename);
+	if (!fout.is_open()) {
+		throw std::runtime_error("Can't open file");
+	}
+	fout << sizeX << " " << sizeY << " " << sizeZ << std::endl;
+	for (int64 i = 0; i < (int64)sizeX * sizeY * sizeZ; i++) {
+		if (i > 0) {
+			fout << " ";
+		}
+		fout << (int)data[i];
+	}
+	fout.close();
+}
+
+template<typename T>
+void VolumetricData<T>::toBinaryFile(const char filename[], VolumeCompression compression) {
+	std::ofstream fout(filename, std::ios::binary);
+	if (!fout.is_open()) {
+		throw std::runtime_error("Can't open file");
+	}
+	int64 sampleCount = (int64)sizeX * sizeY * sizeZ;
+	VolumeFileHeader header;
+	header.sizeX = sizeX;
+	header.sizeY = sizeY;
+	header.sizeZ = sizeZ;
+	header.sampleType = VolumeSampleTypeOf<T>::value;
+	header.layout = VOLUME_LAYOUT_XYZ;
+	header.compression = compression;
+	header.dataOffset = sizeof(VolumeFileHeader);
+	if (compression == VOLUME_COMPRESSION_NONE) {
+		header.dataByteCount = sampleCount * sizeof(T);
+		fout.write((const char*)&header, sizeof(VolumeFileHeader));
+		fout.write((const char*)data, sampleCount * sizeof(T));
+	}
+	else if (compression == VOLUME_COMPRESSION_RLE) {
+		std::vector<char> runs;
+		for (int64 i = 0; i < sampleCount;) {
+			uint32 runLength = 1;
+			while (i + runLength < sampleCount && runLength < 0xFFFFFFFF && memcmp(&data[i + runLength], &data[i], sizeof(T)) == 0) {
+				runLength++;
+			}
+			runs.insert(runs.end(), (const char*)&runLength, (const char*)&runLength + sizeof(uint32));
+			runs.insert(runs.end(), (const char*)&data[i], (const char*)&data[i] + sizeof(T));
+			i += runLength;
+		}
+		header.dataByteCount = runs.size();
+		fout.write((const char*)&header, sizeof(VolumeFileHeader));
+		fout.write(runs.data(), runs.size());
+	}
+	else {
+		throw std::runtime_error("Unknown compression for VolumetricData binary file");
+	}
+	fout.close();
+}
+
+template<typename T>
+void VolumetricData<T>::convertFile(const char inputFilename[], const char outputFilename[], VolumeCompression compression) {
+	bool isInputBinary = isBinaryVolumeFile(inputFilename);
+	VolumetricData<T> volumetricData = fromFile(inputFilename);
+	if (isInputBinary) {
+		volumetricData.toFile(outputFilename);
+	}
+	else {
+		volumetricData.toBinaryFile(outputFilename, compression);
+	}
+}
+
+template<typename T>
+BinaryVolumeSliceSource<T>::BinaryVolumeSliceSource(const char filename[]) : fin(filename, std::ios::binary) {
+	if (!fin.is_open()) {
+		throw std::runtime_error("Can't open file");
+	}
+	fin.seekg(0, std::ios::end);
+	uint64 fileByteCount = fin.tellg();
+	fin.seekg(0, std::ios::beg);
+	if (fileByteCount < sizeof(VolumeFileHeader) || !fin.read((char*)&header, sizeof(VolumeFileHeader))) {
+		throw std::runtime_error("VolumetricData binary file is too small");
+	}
+	header.validate(VolumeSampleTypeOf<T>::value, fileByteCount, sizeof(T));
+	if (header.layout != VOLUME_LAYOUT_XYZ) {
+		throw std::runtime_error("Only the xyz layout can be read slice by slice");
+	}
+	fin.seekg(header.dataOffset, std::ios::beg);
+	nextX = 0;
+	runLength = 0;
+}
+
+template<typename T>
+int BinaryVolumeSliceSource<T>::getSizeX() {
+	return header.sizeX;
+}
+
+template<typename T>
+int BinaryVolumeSliceSource<T>::getSizeY() {
+	return header.sizeY;
+}
+
+template<typename T>
+int BinaryVolumeSliceSource<T>::getSizeZ() {
+	return header.sizeZ;
+}
+
+template<typename T>
+void BinaryVolumeSliceSource<T>::readSlice(int x, T slice[]) {
+	if (x != nextX) {
+		throw std::runtime_error("Slices of a BinaryVolumeSliceSource must be read in order");
+	}
+	int64 sampleCount = (int64)header.sizeY * header.sizeZ;
+	if (header.compression == VOLUME_COMPRESSION_NONE) {
+		if (!fin.read((char*)slice, sampleCount * sizeof(T))) {
+			throw std::runtime_error("VolumetricData binary file is truncated");
+		}
+	}
+	else {
+		for (int64 i = 0; i < sampleCount;) {
+			if (runLength == 0) {
+				if (!fin.read((char*)&runLength, sizeof(uint32)) || !fin.read((char*)&runValue, sizeof(T))) {
+					throw std::runtime_error("VolumetricData binary file is truncated");
+				}
+				continue;
+			}
+			int64 count = std::min((int64)runLength, sampleCount - i);
+			std::fill(slice + i, slice + i + count, runValue);
+			runLength -= (uint32)count;
+			i += count;
+		}
+	}
+	nextX++;
+}
+
+template<typename T>
+CallbackVolumeSliceSource<T>::CallbackVolumeSliceSource(int _sizeX, int _sizeY, int _sizeZ, std::function<void(int, T[])> _sliceReader) {
+	sizeX = _sizeX;
+	sizeY = _sizeY;
+	sizeZ = _sizeZ;
+	sliceReader = _sliceReader;
+}
+
+template<typename T>
+int CallbackVolumeSliceSource<T>::getSizeX() {
+	return sizeX;
+}
+
+template<typename T>
+int CallbackVolumeSliceSource<T>::getSizeY() {
+	return sizeY;
+}
+
+template<typename T>
+int CallbackVolumeSliceSource<T>::getSizeZ() {
+	return sizeZ;
+}
+
+template<typename T>
+void CallbackVolumeSliceSource<T>::readSlice(int x, T slice[]) {
+	sliceReader(x, slice);
+}
+
+template<typename T>
+FieldSliceSource<T>::FieldSliceSource(FieldFunction& _field, int _sizeX, int _sizeY, int _sizeZ, float _scale) : field(_field) {
+	sizeX = _sizeX;
+	sizeY = _sizeY;
+	sizeZ = _sizeZ;
+	scale = _scale;
+}
+
+template<typename T>
+int FieldSliceSource<T>::getSizeX() {
+	return sizeX;
+}
+
+template<typename T>
+int FieldSliceSource<T>::getSizeY() {
+	return sizeY;
+}
+
+template<typename T>
+int FieldSliceSource<T>::getSizeZ() {
+	return sizeZ;
+}
+
+template<typename T>
+void FieldSliceSource<T>::readRow(int x, int y, int z, int count, T samples[]) {
+	row.resize(count);
+	field.evaluateRow(x, y, z, count, row.data());
+	for (int i = 0; i < count; i++) {
+		float value = row[i] * scale;
+		if (std::is_integral<T>::value) {
+			value = std::max((float)std::numeric_limits<T>::lowest(), std::min((float)std::numeric_limits<T>::max(), value));
+			samples[i] = (T)std::lround(value);
+		}
+		else {
+			samples[i] = (T)value;
+		}
+	}
+}
+
+template<typename T>
+void FieldSliceSource<T>::readSlice(int x, T slice[]) {
+	for (int y = 0; y < sizeY; y++) {
+		readRow(x, y, 0, sizeZ, slice + (int64)y * sizeZ);
+	}
+}
+
+template<typename T>
+VolumetricData<T> FieldSliceSource<T>::readBrick(int x, int y, int z, int brickSizeX, int brickSizeY, int brickSizeZ) {
+	VolumetricData<T> brick(brickSizeX, brickSizeY, brickSizeZ);
+	for (int i = 0; i < brickSizeX; i++) {
+		T* slice = brick.getWritableSlice(i);
+		for (int j = 0; j < brickSizeY; j++) {
+			readRow(x + i, y + j, z, brickSizeZ, slice + (int64)j * brickSizeZ);
+		}
+	}
+	return brick;
+}
+
+template<typename T>
+CompressedVolumetricData<T>::CompressedVolumetricData(VolumetricView<T> field, int _brickSize) {
+	if (_brickSize < 1) {
+		throw std::runtime_error("Brick size must be positive in CompressedVolumetricData");
+	}
+	sizeX = field.getSizeX();
+	sizeY = field.getSizeY();
+	sizeZ = field.getSizeZ();
+	brickSize = _brickSize;
+	brickCountX = (sizeX + brickSize - 1) / brickSize;
+	brickCountY = (sizeY + brickSize - 1) / brickSize;
+	brickCountZ = (sizeZ + brickSize - 1) / brickSize;
+	brick.resize((size_t)brickCountX * brickCountY * brickCountZ);
+	for (int bx = 0; bx < brickCountX; bx++) {
+		compressBrickLayer(field.getSubView(bx * brickSize, 0, 0, getBrickExtent(bx, sizeX), sizeY, sizeZ), bx);
+	}
+	payload.shrink_to_fit();
+}
+
+template<typename T>
+CompressedVolumetricData<T>::CompressedVolumetricData(VolumeSliceSource<T>& source, int _brickSize) {
+	if (_brickSize < 1) {
+		throw std::runtime_error("Brick size must be positive in CompressedVolumetricData");
+	}
+	sizeX = source.getSizeX();
+	sizeY = source.getSizeY();
+	sizeZ = source.getSizeZ();
+	brickSize = _brickSize;
+	brickCountX = (sizeX + brickSize - 1) / brickSize;
+	brickCountY = (sizeY + brickSize - 1) / brickSize;
+	brickCountZ = (sizeZ + brickSize - 1) / brickSize;
+	brick.resize((size_t)brickCountX * brickCountY * brickCountZ);
+	int64 sliceSize = (int64)sizeY * sizeZ;
+	std::vector<T> layer(brickSize * sliceSize);
+	for (int bx = 0; bx < brickCountX; bx++) {
+		int extentX = getBrickExtent(bx, sizeX);
+		for (int i = 0; i < extentX; i++) {
+			source.readSlice(bx * brickSize + i, layer.data() + i * sliceSize);
+		}
+		compressBrickLayer(VolumetricView<T>(layer.data(), extentX, sizeY, sizeZ), bx);
+	}
+	payload.shrink_to_fit();
+}
+
+template<typename T>
+int CompressedVolumetricData<T>::getBrickExtent(int brickIndex, int sampleCount) {
+	return std::min(brickSize, sampleCount - brickIndex * brickSize);
+}
+
+template<typename T>
+void CompressedVolumetricData<T>::compressBrickLayer(VolumetricView<T> layer, int brickX) {
+	int extentX = layer.getSizeX();
+	std::vector<T> samples((size_t)brickSize * brickSize * brickSize);
+	for (int by = 0; by < brickCountY; by++) {
+		int extentY = getBrickExtent(by, sizeY);
+		for (int bz = 0; bz < brickCountZ; bz++) {
+			int extentZ = getBrickExtent(bz, sizeZ);
+			for (int i = 0; i < extentX; i++) {
+				for (int j = 0; j < extentY; j++) {
+					memcpy(samples.data() + (i * extentY + j) * extentZ, layer.getRow(i, by * brickSize + j) + bz * brickSize, extentZ * sizeof(T));
+				}
+			}
+			compressBrick(brickX, by, bz, samples.data(), extentX, extentY, extentZ);
+		}
+	}
+}
+
+template<typename T>
+void CompressedVolumetricData<T>::compressBrick(int brickX, int brickY, int brickZ, const T samples[], int extentX, int extentY, int extentZ) {
+	int count = extentX * extentY * extentZ;
+	// a palette of bytes is never smaller than raw byte samples, so they get 4 bit indices at most
+	int maxPaletteSize = (sizeof(T) == 1) ? 16 : 256;
+	T palette[256];
+	int paletteSize = 0;
+	for (int i = 0; i < count && paletteSize <= maxPaletteSize; i++) {
+		// compared bitwise, so decoding gives back exactly the same samples
+		int p = 0;
+		while (p < paletteSize && memcmp(&palette[p], &samples[i], sizeof(T)) != 0) {
+			p++;
+		}
+		if (p == paletteSize) {
+			if (paletteSize == maxPaletteSize) {
+				paletteSize++;
+				break;
+			}
+			palette[paletteSize++] = samples[i];
+		}
+	}
+	Brick& current = brick[((size_t)brickX * brickCountY + brickY) * brickCountZ + brickZ];
+	current.value = samples[0];
+	current.bitsPerIndex = 0;
+	current.offset = 0;
+	if (paletteSize == 1) {
+		current.encoding = BRICK_UNIFORM;
+		return;
+	}
+	int bitsPerIndex = 1;
+	while ((1 << bitsPerIndex) < paletteSize) {
+		bitsPerIndex *= 2;
+	}
+	// the palette takes 2^bitsPerIndex entries, so the indices start at a fixed offset
+	int64 paletteByteCount = ((int64)1 << bitsPerIndex) * sizeof(T);
+	int64 indexByteCount = ((int64)count * bitsPerIndex + 7) / 8;
+	bool isPalette = paletteSize <= maxPaletteSize && paletteByteCount + indexByteCount < (int64)count * (int64)sizeof(T);
+	// the offsets are aligned to the samples, which are read in place
+	current.offset = (int64)((payload.size() + sizeof(T) - 1) / sizeof(T) * sizeof(T));
+	if (isPalette) {
+		current.encoding = BRICK_PALETTE;
+		current.bitsPerIndex = (uint8)bitsPerIndex;
+		payload.resize(current.offset + paletteByteCount + indexByteCount, 0);
+		memcpy(payload.data() + current.offset, palette, paletteSize * sizeof(T));
+		uint8* index = payload.data() + current.offset + paletteByteCount;
+		for (int i = 0; i < count; i++) {
+			int p = 0;
+			while (memcmp(&palette[p], &samples[i], sizeof(T)) != 0) {
+				p++;
+			}
+			int64 bit = (int64)i * bitsPerIndex;
+			index[bit >> 3] |= (uint8)(p << (bit & 7));
+		}
+	}
+	else {
+		current.encoding = BRICK_RAW;
+		payload.resize(current.offset + (int64)count * sizeof(T));
+		memcpy(payload.data() + current.offset, samples, count * sizeof(T));
+	}
+}
+
+template<typename T>
+void CompressedVolumetricData<T>::readBrickRow(const Brick& brick, int x, int y, int z, int extentY, int extentZ, int count, T row[]) {
+	int64 first = ((int64)x * extentY + y) * extentZ + z;
+	if (brick.encoding == BRICK_UNIFORM) {
+		std::fill(row, row + count, brick.value);
+	}
+	else if (brick.encoding == BRICK_RAW) {
+		memcpy(row, (const T*)(payload.data() + brick.offset) + first, count * sizeof(T));
+	}
+	else {
+		int bitsPerIndex = brick.bitsPerIndex;
+		int mask = (1 << bitsPerIndex) - 1;
+		const T* palette = (const T*)(payload.data() + brick.offset);
+		const uint8* index = payload.data() + brick.offset + ((int64)1 << bitsPerIndex) * sizeof(T);
+		for (int i = 0; i < count; i++) {
+			int64 bit = (first + i) * bitsPerIndex;
+			row[i] = palette[(index[bit >> 3] >> (bit & 7)) & mask];
+		}
+	}
+}
+
+template<typename T>
+T CompressedVolumetricData<T>::get(int x, int y, int z) {
+	if (x < 0 || x >= sizeX) {
+		throw std::runtime_error("X dimention out of bound in CompressedVolumetricData get function");
+	}
+	if (y < 0 || y >= sizeY) {
+		throw std::runtime_error("Y dimention out of bound in CompressedVolumetricData get function");
+	}
+	if (z < 0 || z >= sizeZ) {
+		throw std::runtime_error("Z dimention out of bound in CompressedVolumetricData get function");
+	}
+	int bx = x / brickSize, by = y / brickSize, bz = z / brickSize;
+	T value;
+	readBrickRow(brick[((size_t)bx * brickCountY + by) * brickCountZ + bz], x - bx * brickSize, y - by * brickSize, z - bz * brickSize, getBrickExtent(by, sizeY), getBrickExtent(bz, sizeZ), 1, &value);
+	return value;
+}
+
+template<typename T>
+int CompressedVolumetricData<T>::getSizeX() {
+	return sizeX;
+}
+
+template<typename T>
+int CompressedVolumetricData<T>::getSizeY() {
+	return sizeY;
+}
+
+template<typename T>
+int CompressedVolumetricData<T>::getSizeZ() {
+	return sizeZ;
+}
+
+template<typename T>
+void CompressedVolumetricData<T>::readSlice(int x, T slice[]) {
+	readRegion(x, 0, 0, 1, sizeY, sizeZ, slice);
+}
+
+template<typename T>
+void CompressedVolumetricData<T>::readRegion(int x, int y, int z, int regionSizeX, int regionSizeY, int regionSizeZ, T region[]) {
+	if (x < 0 || y < 0 || z < 0 || regionSizeX < 0 || regionSizeY < 0 || regionSizeZ < 0 || x + regionSizeX > sizeX || y + regionSizeY > sizeY || z + regionSizeZ > sizeZ) {
+		throw std::runtime_error("Region out of bound in CompressedVolumetricData readRegion function");
+	}
+	for (int i = 0; i < regionSizeX; i++) {
+		int bx = (x + i) / brickSize;
+		for (int j = 0; j < regionSizeY; j++) {
+			int by = (y + j) / brickSize;
+			int extentY = getBrickExtent(by, sizeY);
+			T* row = region + ((int64)i * regionSizeY + j) * regionSizeZ;
+			// the row crosses the bricks along z one run at a time
+			for (int k = 0; k < regionSizeZ;) {
+				int bz = (z + k) / brickSize;
+				int extentZ = getBrickExtent(bz, sizeZ);
+				int brickZ = z + k - bz * brickSize;
+				int count = std::min(extentZ - brickZ, regionSizeZ - k);
+				readBrickRow(brick[((size_t)bx * brickCountY + by) * brickCountZ + bz], x + i - bx * brickSize, y + j - by * brickSize, brickZ, extentY, extentZ, count, row + k);
+				k += count;
+			}
+		}
+	}
+}
+
+template<typename T>
+VolumetricData<T> CompressedVolumetricData<T>::decompress() {
+	VolumetricData<T> data(sizeX, sizeY, sizeZ);
+	for (int x = 0; x < sizeX; x++) {
+		readSlice(x, data.getWritableSlice(x));
+	}
+	return data;
+}
+
+template<typename T>
+int CompressedVolumetricData<T>::getBrickSize() {
+	return brickSize;
+}
+
+template<typename T>
+int CompressedVolumetricData<T>::getBrickCountX() {
+	return brickCountX;
+}
+
+template<typename T>
+int CompressedVolumetricData<T>::getBrickCountY() {
+	return brickCountY;
+}
+
+template<typename T>
+int CompressedVolumetricData<T>::getBrickCountZ() {
+	return brickCountZ;
+}
+
+template<typename T>
+bool CompressedVolumetricData<T>::isUniform(int brickX, int brickY, int brickZ) {
+	return brick[((size_t)brickX * brickCountY + brickY) * brickCountZ + brickZ].encoding == BRICK_UNIFORM;
+}
+
+template<typename T>
+int CompressedVolumetricData<T>::getUniformBrickCount() {
+	int count = 0;
+	for (size_t i = 0; i < brick.size(); i++) {
+		count += brick[i].encoding == BRICK_UNIFORM;
+	}
+	return count;
+}
+
+template<typename T>
+int CompressedVolumetricData<T>::getPaletteBrickCount() {
+	int count = 0;
+	for (size_t i = 0; i < brick.size(); i++) {
+		count += brick[i].encoding == BRICK_PALETTE;
+	}
+	return count;
+}
+
+template<typename T>
+int64 CompressedVolumetricData<T>::getByteCount() {
+	return (int64)(brick.capacity() * sizeof(Brick) + payload.capacity());
+}
+
+template<typename T>
+BrickSummary<T>::BrickSummary(VolumetricView<T> field, int _brickSize, T _isoThreshold) {
+	brickSize = _brickSize;
+	isoThreshold = _isoThreshold;
+	int cubeCountX = field.getSizeX() - 1;
+	int cubeCountY = field.getSizeY() - 1;
+	int cubeCountZ = field.getSizeZ() - 1;
+	brickCountX = (cubeCountX > 0) ? (cubeCountX + brickSize - 1) / brickSize : 0;
+	brickCountY = (cubeCountY > 0) ? (cubeCountY + brickSize - 1) / brickSize : 0;
+	brickCountZ = (cubeCountZ > 0) ? (cubeCountZ + brickSize - 1) / brickSize : 0;
+	minimum.resize(brickCountX * brickCountY * brickCountZ);
+	maximum.resize(brickCountX * brickCountY * brickCountZ);
+	for (int bx = 0; bx < brickCountX; bx++) {
+		for (int by = 0; by < brickCountY; by++) {
+			for (int bz = 0; bz < brickCountZ; bz++) {
+				// the cubes of a brick use the samples up to and including the first sample of the next brick
+				int zBegin = bz * brickSize;
+				int zEnd = std::min((bz + 1) * brickSize, cubeCountZ);
+				T brickMinimum = field.get(bx * brickSize, by * brickSize, zBegin);
+				T brickMaximum = brickMinimum;
+				for (int x = bx * brickSize; x <= std::min((bx + 1) * brickSize, cubeCountX); x++) {
+					for (int y = by * brickSize; y <= std::min((by + 1) * brickSize, cubeCountY); y++) {
+						const T* row = field.getRow(x, y);
+						for (int z = zBegin; z <= zEnd; z++) {
+							brickMinimum = std::min(brickMinimum, row[z]);
+							brickMaximum = std::max(brickMaximum, row[z]);
+						}
+					}
+				}
+				minimum[getBrickIndex(bx, by, bz)] = brickMinimum;
+				maximum[getBrickIndex(bx, by, bz)] = brickMaximum;
+			}
+		}
+	}
+}
+
+template<typename T>
+int BrickSummary<T>::getBrickIndex(int brickX, int brickY, int brickZ) {
+	return (brickX * brickCountY + brickY) * brickCountZ + brickZ;
+}
+
+template<typename T>
+int BrickSummary<T>::getBrickSize() {
+	return brickSize;
+}
+
+template<typename T>
+int BrickSummary<T>::getBrickCountX() {
+	return brickCountX;
+}
+
+template<typename T>
+int BrickSummary<T>::getBrickCountY() {
+	return brickCountY;
+}
+
+template<typename T>
+int BrickSummary<T>::getBrickCountZ() {
+	return brickCountZ;
+}
+
+template<typename T>
+T BrickSummary<T>::getMinimum(int brickX, int brickY, int brickZ) {
+	return minimum[getBrickIndex(brickX, brickY, brickZ)];
+}
+
+template<typename T>
+T BrickSummary<T>::getMaximum(int brickX, int brickY, int brickZ) {
+	return maximum[getBrickIndex(brickX, brickY, brickZ)];
+}
+
+template<typename T>
+bool BrickSummary<T>::isUniform(int brickX, int brickY, int brickZ) {
+	int brickIndex = getBrickIndex(brickX, brickY, brickZ);
+	return maximum[brickIndex] < isoThreshold || !(minimum[brickIndex] < isoThreshold);
+}
+
+template<typename T>
+int BrickSummary<T>::getUniformBrickCount() {
+	int count = 0;
+	for (int i = 0; i < brickCountX * brickCountY * brickCountZ; i++) {
+		if (maximum[i] < isoThreshold || !(minimum[i] < isoThreshold)) {
+			count++;
+		}
+	}
+	return count;
+}
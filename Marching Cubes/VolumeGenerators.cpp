@@ -0,0 +1,261 @@
+#include "VolumeGenerators.h"
+#include <thread>
+#include <cmath>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VOLUME_GENERATORS_SSE2
+#include <emmintrin.h>
+#endif
+
+VolumetricData<int8> getVolumetricDataOfACube(int sizeX, int sizeY, int sizeZ) {
+	VolumetricData<int8> data(sizeX, sizeY, sizeZ);
+	for (int i = 0; i < sizeX; i++) {
+		int8* slice = data.getWritableSlice(i);
+		for (int j = 0; j < sizeY; j++) {
+			for (int k = 0; k < sizeZ; k++) {
+				slice[j * sizeZ + k] = -1;
+				if (i == 0 || i == (sizeX - 1) || j == 0 || j == (sizeY - 1) || k == 0 || k == (sizeZ - 1))
+					slice[j * sizeZ + k] = 0;
+			}
+		}
+	}
+	return data;
+}
+
+VolumetricData<int8> getVolumetricDataOfARoundEdgeCube(int sizeX, int sizeY, int sizeZ) {
+	VolumetricData<int8> data(sizeX, sizeY, sizeZ);
+	for (int i = 0; i < sizeX; i++) {
+		int8* slice = data.getWritableSlice(i);
+		for (int j = 0; j < sizeY; j++) {
+			for (int k = 0; k < sizeZ; k++) {
+				slice[j * sizeZ + k] = -1;
+				if (i == 0 || i == (sizeX - 1) || j == 0 || j == (sizeY - 1) || k == 0 || k == (sizeZ - 1))
+					slice[j * sizeZ + k] = 1;
+			}
+		}
+	}
+	return data;
+}
+
+VolumetricData<int8> getVolumetricDataOfFlatTerrain(int sizeX, int sizeY, int sizeZ) {
+	VolumetricData<int8> data(sizeX, sizeY, sizeZ);
+	int groundZ = sizeZ / 2;
+	for (int i = 0; i < sizeX; i++) {
+		int8* slice = data.getWritableSlice(i);
+		for (int j = 0; j < sizeY; j++) {
+			for (int k = 0; k < sizeZ; k++) {
+				slice[j * sizeZ + k] = (k < groundZ) ? -1 : ((k == groundZ) ? 0 : 1);
+			}
+		}
+	}
+	return data;
+}
+
+VolumetricData<int8> getVolumetricDataOfWavedTerrain(int sizeX, int sizeY, int sizeZ) {
+	VolumetricData<int8> data(sizeX, sizeY, sizeZ);
+	int groundZ = sizeZ / 2;
+	for (int i = 0; i < sizeX; i++) {
+		int8* slice = data.getWritableSlice(i);
+		for (int j = 0; j < sizeY; j++) {
+			for (int k = 0; k < sizeZ; k++) {
+				slice[j * sizeZ + k] = (k < groundZ) ? -1 : ((k == groundZ) ? -((i & 1) + 1) : 1);
+			}
+		}
+	}
+	return data;
+}
+
+static int8 clampToSample(float value) {
+	return (int8)std::lround(std::max(-127.0f, std::min(127.0f, value)));
+}
+
+VolumetricData<int8> getVolumetricDataOfASphere(int sizeX, int sizeY, int sizeZ) {
+	VolumetricData<int8> data(sizeX, sizeY, sizeZ);
+	float centerX = (sizeX - 1) * 0.5f, centerY = (sizeY - 1) * 0.5f, centerZ = (sizeZ - 1) * 0.5f;
+	float radius = 0.4f * (std::min(std::min(sizeX, sizeY), sizeZ) - 1);
+	SphereField field(centerX, centerY, centerZ, radius);
+	std::vector<float> row(sizeZ);
+	for (int i = 0; i < sizeX; i++) {
+		int8* slice = data.getWritableSlice(i);
+		for (int j = 0; j < sizeY; j++) {
+			field.evaluateRow(i, j, 0, sizeZ, row.data());
+			for (int k = 0; k < sizeZ; k++) {
+				// 32 steps per sample of distance from the surface
+				slice[j * sizeZ + k] = clampToSample(row[k] * 32);
+			}
+		}
+	}
+	return data;
+}
+
+// in [-1, 1], the same for the same lattice point and seed
+static float getLatticeValue(int x, int y, int z, uint32 seed) {
+	uint32 hash = seed * 0x9E3779B1u;
+	hash ^= (uint32)x * 0x8DA6B343u;
+	hash ^= (uint32)y * 0xD8163841u;
+	hash ^= (uint32)z * 0xCB1AB31Fu;
+	hash ^= hash >> 15;
+	hash *= 0x2C1B3C6Du;
+	hash ^= hash >> 12;
+	return (hash & 0xFFFF) / 32767.5f - 1.0f;
+}
+
+static float smoothStep(float t) {
+	return t * t * (3 - 2 * t);
+}
+
+static float getValueNoise(float x, float y, float z, uint32 seed) {
+	int x0 = (int)std::floor(x), y0 = (int)std::floor(y), z0 = (int)std::floor(z);
+	float tx = smoothStep(x - x0), ty = smoothStep(y - y0), tz = smoothStep(z - z0);
+	float value[2][2];
+	for (int i = 0; i < 2; i++) {
+		for (int j = 0; j < 2; j++) {
+			float value0 = getLatticeValue(x0 + i, y0 + j, z0, seed);
+			float value1 = getLatticeValue(x0 + i, y0 + j, z0 + 1, seed);
+			value[i][j] = value0 + (value1 - value0) * tz;
+		}
+	}
+	float value0 = value[0][0] + (value[0][1] - value[0][0]) * ty;
+	float value1 = value[1][0] + (value[1][1] - value[1][0]) * ty;
+	return value0 + (value1 - value0) * tx;
+}
+
+// the slices are generated in parallel, large volumes take long otherwise
+VolumetricData<int8> getVolumetricDataOfNoise(int sizeX, int sizeY, int sizeZ, int featureSize, uint32 seed) {
+	VolumetricData<int8> data(sizeX, sizeY, sizeZ);
+	NoiseField field((float)featureSize, seed);
+	int threadCount = std::max(std::min((int)std::thread::hardware_concurrency(), sizeX), 1);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threadCount; t++) {
+		workers.push_back(std::thread([&data, &field, t, threadCount, sizeX, sizeY, sizeZ]() {
+			std::vector<float> row(sizeZ);
+			for (int i = t; i < sizeX; i += threadCount) {
+				int8* slice = data.getWritableSlice(i);
+				for (int j = 0; j < sizeY; j++) {
+					field.evaluateRow(i, j, 0, sizeZ, row.data());
+					for (int k = 0; k < sizeZ; k++) {
+						slice[j * sizeZ + k] = clampToSample(row[k] * 160);
+					}
+				}
+			}
+		}));
+	}
+	for (int t = 0; t < threadCount; t++) {
+		workers[t].join();
+	}
+	return data;
+}
+
+SphereField::SphereField(float _centerX, float _centerY, float _centerZ, float _radius) {
+	centerX = _centerX;
+	centerY = _centerY;
+	centerZ = _centerZ;
+	radius = _radius;
+}
+
+float SphereField::evaluate(float x, float y, float z) {
+	float dx = x - centerX, dy = y - centerY, dz = z - centerZ;
+	return std::sqrt(dx * dx + dy * dy + dz * dz) - radius;
+}
+
+void SphereField::evaluateRow(int x, int y, int z, int count, float value[]) {
+	float dx = x - centerX, dy = y - centerY;
+	float distanceXY = dx * dx + dy * dy;
+	int i = 0;
+#ifdef VOLUME_GENERATORS_SSE2
+	__m128 distanceXY4 = _mm_set1_ps(distanceXY), centerZ4 = _mm_set1_ps(centerZ), radius4 = _mm_set1_ps(radius);
+	__m128i z4 = _mm_setr_epi32(z, z + 1, z + 2, z + 3);
+	for (; i + 4 <= count; i += 4) {
+		__m128 dz = _mm_sub_ps(_mm_cvtepi32_ps(z4), centerZ4);
+		__m128 distance = _mm_sqrt_ps(_mm_add_ps(distanceXY4, _mm_mul_ps(dz, dz)));
+		_mm_storeu_ps(value + i, _mm_sub_ps(distance, radius4));
+		z4 = _mm_add_epi32(z4, _mm_set1_epi32(4));
+	}
+#endif
+	for (; i < count; i++) {
+		float dz = (z + i) - centerZ;
+		value[i] = std::sqrt(distanceXY + dz * dz) - radius;
+	}
+}
+
+BoxField::BoxField(float _centerX, float _centerY, float _centerZ, float _halfSizeX, float _halfSizeY, float _halfSizeZ) {
+	centerX = _centerX;
+	centerY = _centerY;
+	centerZ = _centerZ;
+	halfSizeX = _halfSizeX;
+	halfSizeY = _halfSizeY;
+	halfSizeZ = _halfSizeZ;
+}
+
+float BoxField::evaluate(float x, float y, float z) {
+	float qx = std::abs(x - centerX) - halfSizeX, qy = std::abs(y - centerY) - halfSizeY, qz = std::abs(z - centerZ) - halfSizeZ;
+	// distance from the closest face inside, from the closest point of the box outside
+	float outsideX = std::max(qx, 0.0f), outsideY = std::max(qy, 0.0f), outsideZ = std::max(qz, 0.0f);
+	return std::sqrt(outsideX * outsideX + outsideY * outsideY + outsideZ * outsideZ) + std::min(std::max(std::max(qx, qy), qz), 0.0f);
+}
+
+PlaneField::PlaneField(float _groundZ) {
+	groundZ = _groundZ;
+}
+
+float PlaneField::evaluate(float /*x*/, float /*y*/, float z) {
+	return z - groundZ;
+}
+
+NoiseField::NoiseField(float _featureSize, uint32 _seed, int _octaveCount) {
+	featureSize = _featureSize;
+	seed = _seed;
+	octaveCount = _octaveCount;
+}
+
+float NoiseField::evaluate(float x, float y, float z) {
+	float value = 0, frequency = 1.0f / featureSize, amplitude = 1;
+	for (int octave = 0; octave < octaveCount; octave++) {
+		value += amplitude * getValueNoise(x * frequency, y * frequency, z * frequency, seed + octave);
+		frequency *= 2;
+		amplitude *= 0.5f;
+	}
+	return value;
+}
+
+// the same arithmetic as getValueNoise, so a row matches evaluate exactly
+void NoiseField::evaluateRow(int x, int y, int z, int count, float value[]) {
+	std::fill(value, value + count, 0.0f);
+	float frequency = 1.0f / featureSize, amplitude = 1;
+	for (int octave = 0; octave < octaveCount; octave++) {
+		uint32 octaveSeed = seed + octave;
+		float fx = x * frequency, fy = y * frequency;
+		int x0 = (int)std::floor(fx), y0 = (int)std::floor(fy);
+		float tx = smoothStep(fx - x0), ty = smoothStep(fy - y0);
+		// the lattice values at z0 and z0 + 1 of the 4 columns around the row
+		float lattice[2][2][2] = {};
+		int cellZ = 0;
+		bool isCellValid = false;
+		for (int k = 0; k < count; k++) {
+			float fz = (z + k) * frequency;
+			int z0 = (int)std::floor(fz);
+			if (!isCellValid || z0 != cellZ) {
+				bool isNextCell = isCellValid && z0 == cellZ + 1;
+				for (int i = 0; i < 2; i++) {
+					for (int j = 0; j < 2; j++) {
+						lattice[i][j][0] = isNextCell ? lattice[i][j][1] : getLatticeValue(x0 + i, y0 + j, z0, octaveSeed);
+						lattice[i][j][1] = getLatticeValue(x0 + i, y0 + j, z0 + 1, octaveSeed);
+					}
+				}
+				cellZ = z0;
+				isCellValid = true;
+			}
+			float tz = smoothStep(fz - z0);
+			float columnValue[2][2];
+			for (int i = 0; i < 2; i++) {
+				for (int j = 0; j < 2; j++) {
+					columnValue[i][j] = lattice[i][j][0] + (lattice[i][j][1] - lattice[i][j][0]) * tz;
+				}
+			}
+			float value0 = columnValue[0][0] + (columnValue[0][1] - columnValue[0][0]) * ty;
+			float value1 = columnValue[1][0] + (columnValue[1][1] - columnValue[1][0]) * ty;
+			value[k] += amplitude * (value0 + (value1 - value0) * tx);
+		}
+		frequency *= 2;
+		amplitude *= 0.5f;
+	}
+}
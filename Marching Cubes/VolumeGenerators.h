@@ -0,0 +1,62 @@
+#include "MarchingCubes.h"
+
+#pragma once
+
+// example volumes, negative inside the surface. they are used by Main.cpp and scaled up by the benchmark
+VolumetricData<int8> getVolumetricDataOfACube(int sizeX, int sizeY, int sizeZ);
+VolumetricData<int8> getVolumetricDataOfARoundEdgeCube(int sizeX, int sizeY, int sizeZ);
+// the terrains are flat volumes of 4 samples in z by default, with the ground at sizeZ / 2
+VolumetricData<int8> getVolumetricDataOfFlatTerrain(int sizeX, int sizeY, int sizeZ = 4);
+VolumetricData<int8> getVolumetricDataOfWavedTerrain(int sizeX, int sizeY, int sizeZ = 4);
+// sphere in the middle of the volume with a radius of 0.4 of its smallest size
+VolumetricData<int8> getVolumetricDataOfASphere(int sizeX, int sizeY, int sizeZ);
+// a few octaves of value noise, a surface full of blobs and tunnels. featureSize is the size of the largest
+// features in samples
+VolumetricData<int8> getVolumetricDataOfNoise(int sizeX, int sizeY, int sizeZ, int featureSize = 32, uint32 seed = 1);
+
+// example fields for FieldSliceSource, in samples and negative inside like the volumes above
+
+// signed distance from the surface of a sphere, evaluated 4 samples at a time with SSE2
+class SphereField : public FieldFunction
+{
+private:
+	float centerX, centerY, centerZ, radius;
+public:
+	SphereField(float centerX, float centerY, float centerZ, float radius);
+	float evaluate(float x, float y, float z);
+	void evaluateRow(int x, int y, int z, int count, float value[]);
+};
+
+// signed distance from the surface of an axis aligned box, halfSize is the distance from its center to its faces
+class BoxField : public FieldFunction
+{
+private:
+	float centerX, centerY, centerZ, halfSizeX, halfSizeY, halfSizeZ;
+public:
+	BoxField(float centerX, float centerY, float centerZ, float halfSizeX, float halfSizeY, float halfSizeZ);
+	float evaluate(float x, float y, float z);
+};
+
+// flat ground at z = groundZ, solid below it
+class PlaneField : public FieldFunction
+{
+private:
+	float groundZ;
+public:
+	PlaneField(float groundZ);
+	float evaluate(float x, float y, float z);
+};
+
+// the value noise of getVolumetricDataOfNoise, in about [-2, 2]. a row reuses the lattice values of the cells
+// it passes through instead of hashing 8 of them per sample and octave
+class NoiseField : public FieldFunction
+{
+private:
+	float featureSize;
+	uint32 seed;
+	int octaveCount;
+public:
+	NoiseField(float featureSize = 32, uint32 seed = 1, int octaveCount = 3);
+	float evaluate(float x, float y, float z);
+	void evaluateRow(int x, int y, int z, int count, float value[]);
+};